@@ -0,0 +1,205 @@
+#include "Batch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "conv.hpp"
+#include "ring.hpp"
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// Paths of the .pgm files directly inside dir (sorted), false if path isn't a directory
+static bool ListPGM(std::string dir, std::vector<std::string>& out) {
+	std::vector<std::string> names;
+#if defined(_WIN32)
+	WIN32_FIND_DATAA entry;
+	HANDLE find = FindFirstFileA((dir + "\\*.pgm").c_str(), &entry);
+	DWORD attributes = GetFileAttributesA(dir.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+		if (find != INVALID_HANDLE_VALUE) { FindClose(find); }
+		return false;
+	}
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) { names.push_back(entry.cFileName); }
+		} while (FindNextFileA(find, &entry));
+		FindClose(find);
+	}
+#else
+	DIR* d = opendir(dir.c_str());
+	if (d == nullptr) { return false; }
+	while (dirent* entry = readdir(d)) {
+		std::string name = entry->d_name;
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".pgm") == 0) { names.push_back(name); }
+	}
+	closedir(d);
+#endif
+	std::sort(names.begin(), names.end());
+	for (const std::string& name : names) { out.push_back(dir + "/" + name); }
+	return true;
+}
+
+static std::string BaseName(const std::string& path) {
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+BatchPipeline::BatchPipeline() {
+	readers = 2;
+	writers = 2;
+	depth = 0;
+	images = failed = 0;
+	pixels = seconds = 0;
+	filters.push_back(new Image<float>(5, 5, H1));
+	filters.push_back(new Image<float>(3, 3, S1));
+	filters.push_back(new Image<float>(3, 3, S2));
+}
+
+BatchPipeline::~BatchPipeline() {
+	for (Image<float>* f : filters) { delete f; }
+}
+
+int BatchPipeline::chain(std::string spec) {
+	steps.clear();
+	size_t start = 0;
+	while (start <= spec.size()) {
+		size_t end = spec.find(',', start);
+		if (end == std::string::npos) { end = spec.size(); }
+		std::string name = spec.substr(start, end - start);
+		start = end + 1;
+
+		if (name == "smooth") {
+			steps.push_back(BatchStep{ BatchOp::Smooth, filters[0] });
+		}
+		else if (name == "sobel") {
+			steps.push_back(BatchStep{ BatchOp::Sobel, nullptr });
+		}
+		else {
+			Image<byte>* filter;
+			int err = OpenPGM(name, &filter);
+			if (err != ERROR_NONE) { return err | ERROR_BATCH_CHAIN; }
+			filters.push_back(new Image<float>(filter->M(), filter->N(), [filter](int m, int n) -> float {
+				return filter->Get(m, n);
+			}));
+			delete filter;
+			steps.push_back(BatchStep{ BatchOp::Filter, filters.back() });
+		}
+	}
+	return ERROR_NONE;
+}
+
+Image<byte>* BatchPipeline::run(Image<byte>* image, ThreadPool& pool) const {
+	for (const BatchStep& step : steps) {
+		Image<byte>* out = nullptr;
+		switch (step.op) {
+			case BatchOp::Smooth:
+				out = Conv2DInt(image, step.filter, ConvMode::Same, CONV_QUANT_ERROR, pool);
+				break;
+
+			case BatchOp::Sobel: {
+				Image<float>* sobel[] = { filters[1], filters[2] };
+				out = Conv2DFused(image, sobel, ConvAbsSum(), ConvMode::Same, pool);
+				break;
+			}
+
+			case BatchOp::Filter:
+				out = Conv2DPeakScaled(image, step.filter, pool);
+				break;
+		}
+		delete image;
+		image = out;
+		if (image == nullptr) { break; }
+	}
+	return image;
+}
+
+// Decoded or finished image with the index of its input
+struct BatchItem {
+	int index;
+	Image<byte>* image;
+};
+
+int BatchPipeline::Process(const std::vector<std::string>& inputs, std::string outDir, ThreadPool& pool) {
+	std::vector<std::string> files;
+	for (const std::string& input : inputs) {
+		if (!ListPGM(input, files)) { files.push_back(input); }
+	}
+
+	images = failed = 0;
+	pixels = seconds = 0;
+	int capacity = depth > 0 ? depth : 2 * pool.Size();
+	BufferArena arena;
+	BoundedQueue<BatchItem> decoded(capacity), encoded(capacity);
+	std::atomic<int> next(0), done(0), errors(0), count(0);
+	std::atomic<long long> area(0);
+	auto start = std::chrono::steady_clock::now();
+
+	// Decode, the loader only maps the file so touch a byte per page to have the read happen here
+	std::vector<std::thread> threads;
+	int R = readers > 0 ? readers : 1;
+	for (int t = 0; t < R; ++t) {
+		threads.push_back(std::thread([&]() -> void {
+			for (int i = next++; i < (int)files.size(); i = next++) {
+				Image<byte>* image;
+				if (OpenPGM(files[i], &image) != ERROR_NONE) {
+					++errors;
+					continue;
+				}
+				volatile byte sink = 0;
+				const byte* p = image->Row(0);
+				for (size_t j = 0; j < (size_t)image->Stride() * image->N(); j += 4096) { sink = sink + p[j]; }
+				area += (long long)image->M() * image->N();
+				decoded.push(BatchItem{ i, image });
+			}
+			if (++done == R) { decoded.close(); }
+		}));
+	}
+
+	// Encode
+	for (int t = 0; t < (writers > 0 ? writers : 1); ++t) {
+		threads.push_back(std::thread([&]() -> void {
+			BatchItem item;
+			while (encoded.pop(item)) {
+				if (SavePGM(outDir + "/" + BaseName(files[item.index]), item.image) != ERROR_NONE) { ++errors; }
+				else { ++count; }
+				delete item.image;
+			}
+		}));
+	}
+
+	// Compute, one dedicated thread per pool thread. These loops live as long as the batch, so they stay off the
+	// pool: a helping caller takes the front task of any queue, and a loop parked there would hold up the image
+	// whose convolution picked it up. The pool only ever sees convolution tiles. Intermediates and results take
+	// their pixels from the arena, the writers hand them back, so after the first few frames the same buffers go
+	// round.
+	std::vector<std::thread> compute;
+	for (int t = 0; t < pool.Size(); ++t) {
+		compute.push_back(std::thread([&]() -> void {
+			ArenaScope scope(arena);
+			BatchItem item;
+			while (decoded.pop(item)) {
+				item.image = run(item.image, pool);
+				if (item.image == nullptr) {
+					++errors;
+					continue;
+				}
+				encoded.push(item);
+			}
+		}));
+	}
+	for (std::thread& t : compute) { t.join(); }
+	encoded.close();
+	for (std::thread& t : threads) { t.join(); }
+
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	images = count;
+	failed = errors;
+	pixels = (double)area;
+	return files.empty() || (images == 0 && failed > 0) ? ERROR_PGM_FILE : ERROR_NONE;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "image.hpp"
+#include "pool.hpp"
+
+// Problem filters (main.cpp)
+extern float H1[25];
+extern float S1[9];
+extern float S2[9];
+
+#define ERROR_BATCH_CHAIN (1 << 8) // unknown step in the filter chain
+
+// One step of a batch filter chain, byte image in and byte image out (Same mode, like the problems)
+enum class BatchOp {
+	Smooth, // H1 in fixed point (Problem 2)
+	Sobel,  // |S1| + |S2| (Problem 3)
+	Filter, // a filter PGM, scaled so the peak is 255 (Problem 4)
+};
+
+struct BatchStep {
+	BatchOp op;
+	Image<float>* filter;
+};
+
+// Decode threads -> compute threads -> encode threads, with a bounded queue between stages
+// Each compute thread takes whole images so small frames keep every core busy, the convolutions inside still split
+// across the pool when a large image is the last one left.
+class BatchPipeline {
+private:
+	std::vector<BatchStep> steps;
+	std::vector<Image<float>*> filters;
+
+	Image<byte>* run(Image<byte>* image, ThreadPool& pool) const;
+
+public:
+	int readers, writers; // decode and encode threads
+	int depth;            // images each queue holds, 0 for twice the pool size
+
+	// Results of the last Process()
+	int images, failed;
+	double pixels, seconds;
+
+	BatchPipeline();
+	~BatchPipeline();
+
+	BatchPipeline(const BatchPipeline& rhs) = delete;
+	BatchPipeline& operator=(BatchPipeline const& rhs) = delete;
+
+	// Comma separated steps, "smooth", "sobel" or the path of a filter PGM
+	int chain(std::string spec);
+
+	// Run every input (PGM files, directories stand for the .pgm files in them) through the chain and save the
+	// results under the same names in outDir. Returns ERROR_NONE unless nothing could be read.
+	int Process(const std::vector<std::string>& inputs, std::string outDir, ThreadPool& pool = ThreadPool::Shared());
+
+	inline double ImagesPerSecond() const { return seconds > 0 ? images / seconds : 0; }
+	inline double MPixelsPerSecond() const { return seconds > 0 ? pixels / seconds / 1e6 : 0; }
+};
@@ -1,6 +1,9 @@
 #include <iostream>
+#include <string>
+#include "Batch.hpp"
 #include "conv.hpp"
 #include "image.hpp"
+#include "match.hpp"
 
 float H1[] = {
 	1 / 81.0f, 2 / 81.0f, 3 / 81.0f, 2 / 81.0f, 1 / 81.0f,
@@ -63,9 +66,39 @@ Image<float>* O1Convolve2D(Image<T1>* image, Image<T2>* filter) {
 	return output;
 }
 
-// Optimization 2 - Multithreading (see conv.hpp)
+// Optimization 2 - Multithreading (see conv.hpp and pool.hpp)
+
+// PA1 --batch <out dir> <step,...> <pgm or dir>...
+// Runs every input through the chain (see BatchPipeline::chain) and saves the results under outDir
+static int Batch(int argc, char** argv) {
+	if (argc < 5) {
+		std::cout << "Usage: PA1 --batch <out dir> <smooth|sobel|filter.pgm,...> <pgm or dir>..." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	BatchPipeline batch;
+	int err = batch.chain(argv[3]);
+	if (err != ERROR_NONE) {
+		std::cout << "Unable to parse the filter chain! Error Code: " << err << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<std::string> inputs(argv + 4, argv + argc);
+	err = batch.Process(inputs, argv[2]);
+	std::cout << batch.images << " images (" << batch.failed << " failed) in " << batch.seconds << " s, "
+		<< batch.ImagesPerSecond() << " images/s, " << batch.MPixelsPerSecond() << " MPixel/s" << std::endl;
+	if (err != ERROR_NONE) {
+		std::cout << "Batch failed! Error Code: " << err << std::endl;
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1 && std::string(argv[1]) == "--batch") {
+		return Batch(argc, argv);
+	}
 
-int main() {
 	int err;
 
 	Image<float>* H1Filter = new Image<float>(5, 5, H1);
@@ -100,36 +133,32 @@ int main() {
 	//}
 
 	// Problem 2
-	Image<float>* H1F = Conv2D(image, H1Filter);
-	Image<byte>* P2 = new Image<byte>(image->M(), image->N(), [H1F, H1Filter](int m, int n) -> byte {
-		float h1 = H1F->Get(m + H1Filter->ConvTailM(), n + H1Filter->ConvTailN()); // Trim convolution tails by shifting
-		if (h1 > 255) { h1 = 255; }
-		if (h1 < 0) { h1 = 0; }
-		return (byte)h1;
-	});
+	// H1 (x/81) quantizes well, so stay in fixed point and saturate straight to bytes (see Conv2DInt)
+	Image<byte>* P2 = Conv2DInt(image, H1Filter, ConvMode::Same);
+	if (P2 == nullptr) {
+		// Quantization error over tolerance, convolve in float and saturate instead
+		Image<float>* F2 = Conv2D(image, H1Filter, ConvMode::Same);
+		P2 = new Image<byte>(F2->M(), F2->N());
+		P2->zip_map(*F2, [](byte, float v) -> byte { return ConvSaturate(v); });
+		delete F2;
+	}
 	err = SavePGM("P2.pgm", P2);
 	if (err != ERROR_NONE) {
 		std::cout << "Unable to save P2.pgm! Error Code: " << err << std::endl;
 		exit(EXIT_FAILURE);
 	}
+	delete P2;
 
 	// Problem 3
-	Image<float>* G1 = Conv2D(image, S1Filter);
-	Image<float>* G2 = Conv2D(image, S2Filter);
-	Image<byte>* P3 = new Image<byte>(image->M(), image->N(), [G1, G2, S1Filter, S2Filter](int m, int n) -> byte {
-		float g1 = G1->Get(m + S1Filter->ConvTailM(), n + S1Filter->ConvTailN()); // Trim convolution tails by shifting
-		float g2 = G2->Get(m + S2Filter->ConvTailM(), n + S2Filter->ConvTailN()); // Trim convolution tails by shifting
-		g1 = g1 < 0 ? g1 * -1 : g1;
-		g2 = g2 < 0 ? g2 * -1 : g2;
-		float sum = g1 + g2;
-		if (sum > 255) { sum = 255; }
-		return (byte)sum;
-	});
+	// |G1| + |G2| in one pass over the image (see Conv2DFused)
+	Image<float>* sobel[] = { S1Filter, S2Filter };
+	Image<byte>* P3 = Conv2DFused(image, sobel, ConvAbsSum(), ConvMode::Same);
 	err = SavePGM("P3.pgm", P3);
 	if (err != ERROR_NONE) {
 		std::cout << "Unable to save P3.pgm! Error Code: " << err << std::endl;
 		exit(EXIT_FAILURE);
 	}
+	delete P3;
 
 	// Problem 4
 
@@ -144,34 +173,29 @@ int main() {
 	//	return v - minScalar;
 	//});
 
-	Image<float>* F1 = Conv2D(image, filter);
-
 	// Scale the filtered image so the maximum value in the image is 255
-	// and all negative values after scaling are set to zero (done in ctor() of P4)
-	//float minF1;
-	float maxF1 = F1->Get(0, 0);
-	F1->each([&maxF1](int m, int n, float v) -> void {
-		//if (v < minF1) { minF1 = v; }
-		if (v > maxF1) { maxF1 = v; }
-	});
-	F1->each([maxF1](int m, int n, float v) -> float {
-		float scaled = v * 255 / maxF1;
-		return scaled;
-	});
-
-	Image<byte>* P4 = new Image<byte>(image->M(), image->N(), [F1, filter](int m, int n) -> byte {
-		float f1 = F1->Get(m + filter->ConvTailM(), n + filter->ConvTailN()); // Trim convolution tails by shifting
-		if (f1 > 255) { f1 = 255; }
-		if (f1 < 0) { f1 = 0; }
-		return (byte)f1;
-	});
+	// and all negative values after scaling are set to zero
+	// Computed on the Same window only, the peak is the window's (the batch Filter step shares this)
+	Image<byte>* P4 = Conv2DPeakScaled(image, filter);
 	err = SavePGM("P4.pgm", P4);
 	if (err != ERROR_NONE) {
 		std::cout << "Unable to save P4.pgm! Error Code: " << err << std::endl;
 		exit(EXIT_FAILURE);
 	}
+	delete P4;
+
+	// The filter is a template, report where it matches best by normalized cross-correlation (see match.hpp)
+	TemplateMatcher matcher(filter);
+	Image<float>* NCC = matcher.Score(image);
+	for (const MatchPeak& peak : matcher.Peaks(NCC, 5, 0.5f)) {
+		std::cout << "Match at (" << peak.m << ", " << peak.n << "), score " << peak.score << std::endl;
+	}
+	delete NCC;
 
 	delete image;
 	delete filter;
+	delete H1Filter;
+	delete S1Filter;
+	delete S2Filter;
 	return 0;
 }
@@ -0,0 +1,96 @@
+#include "FilterDesign.hpp"
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#define PI 3.14159265358979323846
+
+double KaiserBeta(double atten) {
+	if (atten > 50) { return 0.1102 * (atten - 8.7); }
+	if (atten > 21) { return 0.5842 * pow(atten - 21, 0.4) + 0.07886 * (atten - 21); }
+	return 0;
+}
+
+int KaiserTaps(double atten, double transition) {
+	int order = (int)ceil((atten - 7.95) / (2.285 * PI * transition));
+	return (order > 0 ? order : 0) + 1;
+}
+
+// Zeroth order modified Bessel function of the first kind, by its power series
+static double BesselI0(double x) {
+	double sum = 1, term = 1;
+	for (int k = 1; k < 64; ++k) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if (term < sum * 1e-17) { break; }
+	}
+	return sum;
+}
+
+std::vector<float> KaiserLowpass(int taps, double cutoff, double beta, double gain) {
+	std::vector<float> h(taps);
+	double center = (taps - 1) / 2.0;
+	double norm = BesselI0(beta);
+	for (int n = 0; n < taps; ++n) {
+		double t = n - center;
+		double x = cutoff * t;
+		// Exact zeros where the sinc crosses them, so Nyquist (halfband) designs get taps that are really 0
+		double sinc = t == 0 ? 1 : fabs(x - floor(x + 0.5)) < 1e-9 ? 0 : sin(PI * x) / (PI * x);
+		double r = center > 0 ? t / center : 0;
+		double window = BesselI0(beta * sqrt(1 - r * r > 0 ? 1 - r * r : 0)) / norm;
+		h[n] = (float)(gain * cutoff * sinc * window);
+	}
+	return h;
+}
+
+int GCD(int a, int b) {
+	while (b != 0) {
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+typedef std::tuple<int, double, double, double> PolyFilterKey;
+
+static std::mutex cacheLock;
+static std::map<PolyFilterKey, std::shared_ptr<const PolyFilter>> cache;
+
+std::shared_ptr<const PolyFilter> DesignPolyFilter(int L, int M, double passband, double atten) {
+	int g = GCD(L, M);
+	L /= g;
+	M /= g;
+
+	// Band edges as fractions of the Nyquist rate at L times the input rate
+	double stop = 1.0 / (L > M ? L : M);
+	return DesignPolyFilterBand(L, passband * stop, stop, atten);
+}
+
+std::shared_ptr<const PolyFilter> DesignPolyFilterBand(int L, double pass, double stop, double atten) {
+	PolyFilterKey key(L, pass, stop, atten);
+	std::lock_guard<std::mutex> guard(cacheLock);
+	auto it = cache.find(key);
+	if (it != cache.end()) { return it->second; }
+
+	int taps = KaiserTaps(atten, stop - pass);
+	double cutoff = (pass + stop) / 2;
+	// A cutoff of 1 / L zeroes every L-th tap from the center, which needs the center on a tap (odd length)
+	if (fabs(cutoff * L - 1) < 1e-12 && taps % 2 == 0) { ++taps; }
+	std::vector<float> h = KaiserLowpass(taps, cutoff, KaiserBeta(atten), L);
+	std::shared_ptr<const PolyFilter> bank = std::make_shared<const PolyFilter>(L, h.data(), (int)h.size());
+	cache[key] = bank;
+	return bank;
+}
+
+std::shared_ptr<const PolyFilter> DesignHalfband(double passband, double atten) {
+	// Band edges mirrored around half of Nyquist at twice the input rate, the cutoff lands on 0.5
+	double pass = passband / 2;
+	return DesignPolyFilterBand(2, pass, 1 - pass, atten);
+}
+
+void ClearPolyFilterCache() {
+	std::lock_guard<std::mutex> guard(cacheLock);
+	cache.clear();
+}
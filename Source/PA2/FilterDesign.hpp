@@ -0,0 +1,37 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "PolyFilter.hpp"
+
+// Default anti-aliasing spec for DesignPolyFilter
+#define DESIGN_PASSBAND     0.9  // passband edge as a fraction of the narrower of the two Nyquist bands
+#define DESIGN_ATTENUATION  80.0 // stopband attenuation in dB
+
+// Kaiser window parameters for a stopband attenuation in dB and a transition width (fraction of Nyquist)
+double KaiserBeta(double atten);
+int KaiserTaps(double atten, double transition);
+
+// Windowed sinc lowpass with the cutoff at a fraction of Nyquist and a DC gain of gain
+std::vector<float> KaiserLowpass(int taps, double cutoff, double beta, double gain);
+
+int GCD(int a, int b);
+
+// Polyphase bank for resampling by L/M (L/M need not be reduced)
+// The prototype is a Kaiser windowed sinc at L times the input rate, flat up to passband of the lower Nyquist
+// rate and attenuated by atten dB from that Nyquist rate on, with a gain of L to make up for the inserted zeros.
+// Banks are designed once per (L/M reduced, passband, atten), that is per (L, band edges, atten), and cached for
+// the life of the process, streams at the same ratio share one read-only table.
+std::shared_ptr<const PolyFilter> DesignPolyFilter(int L, int M, double passband = DESIGN_PASSBAND, double atten = DESIGN_ATTENUATION);
+
+// Bank for an up-sampling factor L with explicit band edges (fractions of the Nyquist rate at L times the input
+// rate), for stages whose transition band can be wider than the plain L/M spec (see ResamplePlan). Also cached.
+std::shared_ptr<const PolyFilter> DesignPolyFilterBand(int L, double pass, double stop, double atten);
+
+// Halfband bank for doubling the rate, flat to passband of the input Nyquist rate. The transition band is centred
+// on the input Nyquist rate rather than ending there (images just above it are only partly attenuated), in
+// exchange every other tap is zero, so one of the two phases is a plain delay and costs one multiply per output.
+// The same bank decimates by 2 in HalfbandDecimator, where the band edges are fractions of its input Nyquist rate.
+std::shared_ptr<const PolyFilter> DesignHalfband(double passband = DESIGN_PASSBAND, double atten = DESIGN_ATTENUATION);
+
+// Drop the cached banks (banks still held by resamplers stay alive until they're done)
+void ClearPolyFilterCache();
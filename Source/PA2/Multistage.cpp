@@ -0,0 +1,195 @@
+#include "Multistage.hpp"
+#include <cmath>
+#include <sstream>
+
+// Cost of a stage per sample it takes in (the feed call and delay line writes) and per dot product on top of
+// its MACs (call, setup and reduction), in MACs as measured with AVX-512. They keep the planner from splitting off
+// stages that only save a few taps.
+#define STAGE_INPUT_COST  60
+#define STAGE_OUTPUT_COST 150
+
+// Fill in the band edges, lengths and costs of plan's stages, false if some stage can't meet the spec
+// Rates are in units of the input rate. Every stage passes the final band [0, fp]. An earlier stage only has to
+// stop what would alias below the final stopband edge fs, from min(in, out rate) - fs on; the last one stops
+// from half of it like a single stage design does.
+static bool Evaluate(ResamplePlan& plan) {
+	double Fo = (double)plan.L / plan.M;
+	double Fmin = Fo < 1 ? Fo : 1;
+	double fp = plan.passband * Fmin / 2;
+	double fs = Fmin / 2;
+
+	double rate = 1;
+	double macs = 0, cost = 0;
+	for (size_t i = 0; i < plan.stages.size(); ++i) {
+		ResampleStage& s = plan.stages[i];
+		double nyquist = rate * s.L / 2;
+		double out = rate * s.L / s.M;
+		double edge = rate < out ? rate : out;
+		double stop = i + 1 == plan.stages.size() ? edge / 2 : edge - fs;
+		if (stop <= fp) { return false; }
+
+		s.pass = fp / nyquist;
+		s.stop = stop / nyquist;
+		s.taps = KaiserTaps(plan.atten, s.stop - s.pass);
+		// One dot product per output of the stage, over ceil(taps / L) padded like PolyFilter rows
+		s.macs = out * (((s.taps + s.L - 1) / s.L + 15) / 16 * 16);
+		s.halfband = false;
+		double dots = out;
+
+		// By 2 a halfband passing up to h >= pass and stopping from 1 - h <= stop also does, the lowest h gives the
+		// widest transition band. Its dense phase is one dot product per output (1/2) or per pair of outputs (2/1),
+		// the other phase a single multiply.
+		if (s.L * s.M == 2) {
+			double h = s.pass > 1 - s.stop ? s.pass : 1 - s.stop;
+			if (h < 0.5) {
+				// Odd like DesignPolyFilterBand makes it for a cutoff of 1/2
+				int taps = KaiserTaps(plan.atten, (1 - h) - h);
+				taps += taps % 2 == 0 ? 1 : 0;
+				double pairs = rate < out ? rate : out;
+				double half = pairs * (((taps + 1) / 2 + 15) / 16 * 16 + 1);
+				if (half + pairs * STAGE_OUTPUT_COST < s.macs + out * STAGE_OUTPUT_COST) {
+					s.pass = h;
+					s.stop = 1 - h;
+					s.taps = taps;
+					s.macs = half;
+					s.halfband = true;
+					dots = pairs;
+				}
+			}
+		}
+
+		macs += s.macs;
+		cost += s.macs + rate * STAGE_INPUT_COST + dots * STAGE_OUTPUT_COST;
+		rate = out;
+	}
+	plan.macs = macs / Fo;
+	plan.cost = cost / Fo;
+	return true;
+}
+
+static void Divisors(int n, std::vector<int>& out) {
+	out.clear();
+	for (int d = 1; d <= n; ++d) {
+		if (n % d == 0) { out.push_back(d); }
+	}
+}
+
+// Every ordered factorization of L/M into coprime stage ratios, rates never dropping below Fmin
+static void Search(ResamplePlan& plan, int L, int M, double rate, double Fmin, int maxStages, ResamplePlan& best) {
+	if (L == 1 && M == 1) {
+		if (Evaluate(plan) && (best.stages.empty() || plan.cost < best.cost)) { best = plan; }
+		return;
+	}
+	if ((int)plan.stages.size() == maxStages) { return; }
+
+	std::vector<int> ls, ms;
+	Divisors(L, ls);
+	Divisors(M, ms);
+	for (int l : ls) {
+		for (int m : ms) {
+			if ((l == 1 && m == 1) || GCD(l, m) != 1) { continue; }
+			double out = rate * l / m;
+			if (out < Fmin * (1 - 1e-9)) { continue; }
+
+			ResampleStage stage = { l, m, 0, 0, 0, 0, false };
+			plan.stages.push_back(stage);
+			Search(plan, L / l, M / m, out, Fmin, maxStages, best);
+			plan.stages.pop_back();
+		}
+	}
+}
+
+ResamplePlan ResamplePlan::Single(int L, int M, double passband, double atten) {
+	int g = GCD(L, M);
+	ResamplePlan plan;
+	plan.L = L / g;
+	plan.M = M / g;
+	plan.passband = passband;
+	plan.atten = atten;
+	ResampleStage stage = { plan.L, plan.M, 0, 0, 0, 0, false };
+	plan.stages.push_back(stage);
+	Evaluate(plan);
+	return plan;
+}
+
+ResamplePlan ResamplePlan::Best(int L, int M, double passband, double atten, int maxStages) {
+	ResamplePlan best = Single(L, M, passband, atten);
+	ResamplePlan plan;
+	plan.L = best.L;
+	plan.M = best.M;
+	plan.passband = passband;
+	plan.atten = atten;
+	double Fo = (double)plan.L / plan.M;
+	Search(plan, plan.L, plan.M, 1, Fo < 1 ? Fo : 1, maxStages, best);
+	return best;
+}
+
+std::string ResamplePlan::Describe() const {
+	std::ostringstream str;
+	str << L << "/" << M << " =";
+	for (size_t i = 0; i < stages.size(); ++i) {
+		str << (i > 0 ? " ->" : "") << " " << stages[i].L << "/" << stages[i].M << (stages[i].halfband ? " halfband" : "");
+	}
+	str << " (";
+	double Fo = (double)L / M;
+	for (size_t i = 0; i < stages.size(); ++i) {
+		str << (i > 0 ? " + " : "") << floor(stages[i].macs / Fo * 10 + 0.5) / 10;
+	}
+	str << " MACs/output)";
+	return str.str();
+}
+
+MultistageResampler::MultistageResampler(const ResamplePlan& plan) {
+	maxOut = 1;
+	int block = MULTISTAGE_BLOCK;
+	for (const ResampleStage& s : plan.stages) {
+		Stage stage = { nullptr, nullptr };
+		if (s.halfband) {
+			// Up by 2 the delay phase is already a single multiply in PolyResampler
+			std::shared_ptr<const PolyFilter> bank = DesignHalfband(2 * s.pass, plan.atten);
+			if (s.L == 2) { stage.poly = new PolyResampler(2, 1, bank); }
+			else { stage.halfband = new HalfbandDecimator(bank); }
+		}
+		else {
+			stage.poly = new PolyResampler(s.L, s.M, DesignPolyFilterBand(s.L, s.pass, s.stop, plan.atten));
+		}
+		stages.push_back(stage);
+		maxOut *= stage.MaxOut();
+		block = stage.MaxOut(block);
+		buffers.push_back(std::vector<float>(block > maxOut ? block : maxOut));
+	}
+	buffers.pop_back();
+}
+
+MultistageResampler::~MultistageResampler() {
+	for (Stage& s : stages) {
+		delete s.poly;
+		delete s.halfband;
+	}
+}
+
+int MultistageResampler::MaxOut(int n) const {
+	// Stage by stage bound, each rounds its own count up
+	for (const Stage& s : stages) { n = s.MaxOut(n); }
+	return n;
+}
+
+int MultistageResampler::run(int s, const float* in, int n, float* out) {
+	bool last = s + 1 == (int)stages.size();
+	float* dst = last ? out : buffers[s].data();
+	int count = stages[s].process(in, n, dst);
+	return last || count == 0 ? count : run(s + 1, dst, count, out);
+}
+
+int MultistageResampler::feed(float xn, float* out) {
+	return run(0, &xn, 1, out);
+}
+
+int MultistageResampler::process(const float* in, int n, float* out) {
+	int count = 0;
+	for (int i = 0; i < n; i += MULTISTAGE_BLOCK) {
+		int len = n - i < MULTISTAGE_BLOCK ? n - i : MULTISTAGE_BLOCK;
+		count += run(0, in + i, len, out + count);
+	}
+	return count;
+}
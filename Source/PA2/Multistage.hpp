@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "FilterDesign.hpp"
+#include "PolyFilter.hpp"
+
+// One rational stage of a ResamplePlan
+struct ResampleStage {
+	int L, M;
+	double pass, stop; // band edges, fractions of the Nyquist rate the stage filters at (L times its input rate)
+	int taps;
+	double macs;       // per input sample of the whole cascade (padded dot product lengths)
+	bool halfband;     // 2/1 or 1/2 on DesignHalfband(2 pass), pass and stop are then mirrored around 1/2
+};
+
+// Cascade of rational stages that together resample by L/M with the same passband and stopband spec as the single
+// stage DesignPolyFilter(L, M, passband, atten). Only the last stage needs the narrow transition band, every
+// earlier stage just has to keep what would alias below the final stopband edge out, so their filters are short
+// and the long one runs at a low rate. A stage by 2 whose band edges leave room for a halfband (transition band
+// centred on 1/2) is one when that is cheaper, skipping its zero taps.
+class ResamplePlan {
+public:
+	int L, M;
+	double passband, atten;
+	std::vector<ResampleStage> stages;
+	double macs; // per output sample
+	double cost; // macs plus the per stage overhead, what Best() minimizes
+
+	ResamplePlan() {
+		L = M = 1;
+		passband = DESIGN_PASSBAND;
+		atten = DESIGN_ATTENUATION;
+		macs = cost = 0;
+	}
+
+	// The plain single stage design, for comparison
+	static ResamplePlan Single(int L, int M, double passband = DESIGN_PASSBAND, double atten = DESIGN_ATTENUATION);
+
+	// Cheapest cascade of at most maxStages stages (L/M reduced, stages factor L and M, no intermediate rate below
+	// the lower of the input and output rates)
+	static ResamplePlan Best(int L, int M, double passband = DESIGN_PASSBAND, double atten = DESIGN_ATTENUATION, int maxStages = 4);
+
+	// e.g. "1/96 = 1/48 -> 1/2 (928 + 208 MACs/output)", "64/1 = 2/1 -> 2/1 halfband -> 16/1 (3.5 + 0.5 + 16 MACs/output)"
+	std::string Describe() const;
+};
+
+// Inputs pushed through the cascade at once by process()
+#define MULTISTAGE_BLOCK 1024
+
+// Runs a ResamplePlan, each stage is a PolyResampler on a cached bank, or a HalfbandDecimator for halfband 1/2 stages
+class MultistageResampler {
+private:
+	// One of the two is set
+	struct Stage {
+		PolyResampler* poly;
+		HalfbandDecimator* halfband;
+
+		inline int MaxOut() const { return poly ? poly->MaxOut() : halfband->MaxOut(); }
+		inline int MaxOut(int n) const { return poly ? poly->MaxOut(n) : halfband->MaxOut(n); }
+		inline int process(const float* in, int n, float* out) { return poly ? poly->process(in, n, out) : halfband->process(in, n, out); }
+	};
+	std::vector<Stage> stages;
+	std::vector<std::vector<float>> buffers; // outputs of each stage but the last for MULTISTAGE_BLOCK inputs
+	int maxOut;
+
+	int run(int s, const float* in, int n, float* out);
+
+public:
+	MultistageResampler(const ResamplePlan& plan);
+	~MultistageResampler();
+
+	MultistageResampler(const MultistageResampler& rhs) = delete;
+	MultistageResampler& operator=(MultistageResampler const& rhs) = delete;
+
+	// Most outputs a single feed() can produce
+	inline int MaxOut() const { return maxOut; }
+	// Most outputs a process() of n inputs can produce
+	int MaxOut(int n) const;
+
+	// Push one input sample, writes the outputs it completes to out (at most MaxOut()) and returns their count
+	int feed(float xn, float* out);
+
+	// Push n input samples, writes the outputs they complete to out (at most MaxOut(n)) and returns their count
+	// Runs the cascade MULTISTAGE_BLOCK inputs at a time through buffers sized at construction, no allocation.
+	int process(const float* in, int n, float* out);
+};
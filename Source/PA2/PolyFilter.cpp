@@ -1,5 +1,289 @@
 #include "PolyFilter.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "FilterDesign.hpp"
+#include "simd.hpp"
 
-void PolyFilter::feed(float xn) {
-	
+PolyFilter::PolyFilter(int up, const float* h, int n) {
+	U = up;
+	K = (n + U - 1) / U;
+	length = n;
+	stride = (K + 15) / 16 * 16;
+
+	raw = new float[U * stride + 16]();
+	table = (float*)(((uintptr_t)raw + 63) & ~(uintptr_t)63);
+	for (int p = 0; p < U; ++p) {
+		float* c = table + p * stride;
+		for (int r = 0; r < K; ++r) {
+			int i = p + (K - 1 - r) * U;
+			c[r] = i < n ? h[i] : 0;
+		}
+
+		PolyPhase span = { 0, 0, FirSymmetry::None };
+		int last = K - 1;
+		while (span.first < K && c[span.first] == 0) { ++span.first; }
+		while (last > span.first && c[last] == 0) { --last; }
+		if (span.first < K) {
+			span.taps = last - span.first + 1;
+			span.symmetry = FirDetectSymmetry(c + span.first, span.taps);
+		}
+		else {
+			span.first = 0;
+		}
+		spans.push_back(span);
+	}
+}
+
+PolyFilter::~PolyFilter() {
+	delete[] raw;
+}
+
+PolyResampler::PolyResampler(int up, int down, Signal<float>* filter) {
+	std::vector<float> h(filter->N());
+	for (int i = 0; i < filter->N(); ++i) { h[i] = filter->Get(i); }
+	init(up, down, std::make_shared<const PolyFilter>(up, h.data(), filter->N()));
+}
+
+PolyResampler::PolyResampler(int up, int down, std::shared_ptr<const PolyFilter> filter) {
+	init(up, down, filter);
+}
+
+PolyResampler::PolyResampler(int up, int down, double passband, double atten) {
+	int g = GCD(up, down);
+	init(up / g, down / g, DesignPolyFilter(up, down, passband, atten));
+}
+
+void PolyResampler::init(int up, int down, std::shared_ptr<const PolyFilter> filter) {
+	U = up;
+	D = down;
+	bank = filter;
+
+	// K samples, their copy, and the padding the last window reads past the copy (zero taps)
+	line = new float[bank->Taps() + bank->Stride()]();
+	w = 0;
+	phase = 0;
+}
+
+PolyResampler::~PolyResampler() {
+	delete[] line;
+}
+
+int PolyResampler::process(const float* in, int n, float* out) {
+	const PolyFilter& filter = *bank;
+	int K = filter.Taps();
+	int S = filter.Stride();
+	int wi = w, p = phase;
+	int count = 0;
+	// Without SIMD, folding the symmetric phases halves their multiplies, with it the padded DotF32 is faster
+	bool fold = SimdActive() == SimdLevel::Scalar;
+	for (int i = 0; i < n; ++i) {
+		line[wi] = in[i];
+		line[wi + K] = in[i];
+		wi = wi + 1 < K ? wi + 1 : 0;
+
+		// line[wi .. wi + K) is now x[j - K + 1] .. x[j], emit every output with jU <= mD < (j + 1)U
+		const float* window = line + wi;
+		for (; p < U; p += D) {
+			const PolyPhase& span = filter.Span(p);
+			const float* c = filter.Phase(p);
+			if (span.taps <= 1) {
+				// Delay phase (halfband and other Nyquist filters), one multiply
+				out[count++] = c[span.first] * window[span.first];
+			}
+			else if (fold && span.symmetry != FirSymmetry::None) {
+				out[count++] = FirDotFolded(c + span.first, window + span.first, span.taps, span.symmetry);
+			}
+			else {
+				out[count++] = DotF32(c, window, S);
+			}
+		}
+		p -= U;
+	}
+	w = wi;
+	phase = p;
+	return count;
+}
+
+void PolyResampler::restart(long long j0, const float* history, int n) {
+	int K = bank->Taps();
+	std::fill(line, line + K + bank->Stride(), 0.0f);
+	w = 0;
+	for (int i = n > K - 1 ? n - (K - 1) : 0; i < n; ++i) {
+		line[w] = history[i];
+		line[w + K] = history[i];
+		w = w + 1 < K ? w + 1 : 0;
+	}
+	// The next output m is the first with mD >= j0 U
+	phase = (int)((D - j0 * U % D) % D);
+}
+
+HalfbandDecimator::HalfbandDecimator(std::shared_ptr<const PolyFilter> filter) {
+	bank = filter;
+	line = new float[2 * (bank->Taps() + bank->Stride())]();
+	w[0] = w[1] = 0;
+	next = 0;
+}
+
+HalfbandDecimator::~HalfbandDecimator() {
+	delete[] line;
+}
+
+int HalfbandDecimator::process(const float* in, int n, float* out) {
+	const PolyFilter& filter = *bank;
+	int K = filter.Taps();
+	int S = filter.Stride();
+	int p = next;
+	int count = 0;
+	bool fold = SimdActive() == SimdLevel::Scalar;
+	for (int i = 0; i < n; ++i) {
+		float* lp = line + p * (K + S);
+		lp[w[p]] = in[i];
+		lp[w[p] + K] = in[i];
+		w[p] = w[p] + 1 < K ? w[p] + 1 : 0;
+		if (p == 1) {
+			p = 0;
+			continue;
+		}
+		p = 1;
+
+		// Input 2m just landed, phase 0 sees x[2m - 2K + 2] .. x[2m] and phase 1 x[2m - 2K + 1] .. x[2m - 1]
+		float sum = 0;
+		for (int q = 0; q < 2; ++q) {
+			const PolyPhase& span = filter.Span(q);
+			const float* c = filter.Phase(q);
+			const float* window = line + q * (K + S) + w[q];
+			if (span.taps <= 1) {
+				// The center tap of a halfband, one multiply
+				sum += c[span.first] * window[span.first];
+			}
+			else if (fold && span.symmetry != FirSymmetry::None) {
+				sum += FirDotFolded(c + span.first, window + span.first, span.taps, span.symmetry);
+			}
+			else {
+				sum += DotF32(c, window, S);
+			}
+		}
+		// The bank carries the interpolation gain of 2
+		out[count++] = 0.5f * sum;
+	}
+	next = p;
+	return count;
+}
+
+int ResampleParallel(int up, int down, std::shared_ptr<const PolyFilter> bank, const float* in, int n, float* out, ThreadPool& pool) {
+	// A few chunks per thread so the stealing evens out, whole periods of down inputs each
+	long long chunk = (long long)n / (pool.Size() * 4) + 1;
+	chunk = chunk > RESAMPLE_CHUNK ? chunk : RESAMPLE_CHUNK;
+	chunk = (chunk + down - 1) / down * down;
+	int chunks = (int)((n + chunk - 1) / chunk);
+
+	int history = bank->Taps() - 1;
+	pool.Run(chunks, [&](int c) -> void {
+		long long j0 = c * chunk;
+		long long j1 = j0 + chunk < n ? j0 + chunk : n;
+		int h = j0 < history ? (int)j0 : history;
+		PolyResampler resampler(up, down, bank);
+		resampler.restart(j0, in + j0 - h, h);
+		resampler.process(in + j0, (int)(j1 - j0), out + j0 / down * up);
+	});
+	return (int)(((long long)n * up + down - 1) / down);
+}
+
+MultiChannelResampler::MultiChannelResampler(int up, int down, int channels, Signal<float>* filter) {
+	std::vector<float> h(filter->N());
+	for (int i = 0; i < filter->N(); ++i) { h[i] = filter->Get(i); }
+	init(up, down, channels, std::make_shared<const PolyFilter>(up, h.data(), filter->N()));
+}
+
+MultiChannelResampler::MultiChannelResampler(int up, int down, int channels, std::shared_ptr<const PolyFilter> filter) {
+	init(up, down, channels, filter);
+}
+
+MultiChannelResampler::MultiChannelResampler(int up, int down, int channels, double passband, double atten) {
+	int g = GCD(up, down);
+	init(up / g, down / g, channels, DesignPolyFilter(up, down, passband, atten));
+}
+
+void MultiChannelResampler::init(int up, int down, int channels, std::shared_ptr<const PolyFilter> filter) {
+	U = up;
+	D = down;
+	C = channels;
+	P = C <= 2 ? C : C <= 4 ? 4 : (C + 7) / 8 * 8;
+	bank = filter;
+	int K = bank->Taps();
+	int S = bank->Stride();
+
+	raw = nullptr;
+	table = nullptr;
+	if (P == 2 || P == 4) {
+		raw = new float[U * S * P + 16]();
+		table = (float*)(((uintptr_t)raw + 63) & ~(uintptr_t)63);
+		for (int p = 0; p < U; ++p) {
+			const float* c = bank->Phase(p);
+			float* e = table + p * S * P;
+			for (int r = 0; r < S; ++r) {
+				for (int k = 0; k < P; ++k) { e[r * P + k] = c[r]; }
+			}
+		}
+	}
+
+	line = new float[(K + S) * P]();
+	sums = new float[P > 16 ? P : 16];
+	w = 0;
+	phase = 0;
+}
+
+MultiChannelResampler::~MultiChannelResampler() {
+	delete[] raw;
+	delete[] line;
+	delete[] sums;
+}
+
+int MultiChannelResampler::process(const float* in, int n, float* out) {
+	const PolyFilter& filter = *bank;
+	int K = filter.Taps();
+	int S = filter.Stride();
+	int wi = w, p = phase;
+	int count = 0;
+	for (int i = 0; i < n; ++i) {
+		const float* frame = in + i * C;
+		float* slot = line + wi * P;
+		for (int ch = 0; ch < C; ++ch) {
+			slot[ch] = frame[ch];
+			slot[K * P + ch] = frame[ch];
+		}
+		wi = wi + 1 < K ? wi + 1 : 0;
+
+		const float* window = line + wi * P;
+		for (; p < U; p += D) {
+			float* y = out + count * C;
+			const PolyPhase& span = filter.Span(p);
+			if (span.taps <= 1) {
+				float c = filter.Phase(p)[span.first];
+				for (int ch = 0; ch < C; ++ch) { y[ch] = c * window[span.first * P + ch]; }
+			}
+			else if (P == 1) {
+				y[0] = DotF32(filter.Phase(p), window, S);
+			}
+			else if (P <= 4) {
+				// Fold the 16 lanes down to P channels
+				DotF32x16(table + p * S * P, window, S * P, sums);
+				for (int ch = 0; ch < C; ++ch) {
+					float sum = 0;
+					for (int k = ch; k < 16; k += P) { sum += sums[k]; }
+					y[ch] = sum;
+				}
+			}
+			else {
+				DotF32Bcast(filter.Phase(p), window, P, K, P, sums);
+				for (int ch = 0; ch < C; ++ch) { y[ch] = sums[ch]; }
+			}
+			++count;
+		}
+		p -= U;
+	}
+	w = wi;
+	phase = p;
+	return count;
 }
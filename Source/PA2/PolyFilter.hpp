@@ -1,2 +1,176 @@
 #pragma once
+#include <memory>
+#include <vector>
+#include "fir.hpp"
+#include "pool.hpp"
 #include "signal.hpp"
+
+// Polyphase decomposition of an interpolation filter h for an up-sampling factor U
+// Phase p holds h[p], h[p + U], h[p + 2U], ... reversed, so that its dot product with the delay line (oldest
+// sample first) is the output. All phases live in one 64-byte aligned table, each row zero padded to a
+// multiple of 16 floats so the dot products never need a scalar tail.
+// Each phase also records the span of its nonzero taps and whether that span is mirror symmetric. A symmetric
+// prototype (linear phase) makes the phases pairwise mirrored and some of them symmetric on their own, and a
+// Nyquist prototype (halfband for U = 2) leaves one phase with a single tap, which is then just a scaled delay.
+struct PolyPhase {
+	int first, taps;
+	FirSymmetry symmetry;
+};
+
+class PolyFilter {
+private:
+	int U, K, stride;
+	int length;
+	float* raw;
+	float* table;
+	std::vector<PolyPhase> spans;
+
+public:
+	PolyFilter(int up, const float* h, int n);
+	~PolyFilter();
+
+	PolyFilter(const PolyFilter& rhs) = delete;
+	PolyFilter& operator=(PolyFilter const& rhs) = delete;
+
+	// Phases, taps per phase (ceil(n / U)) and padded row length
+	inline int Phases() const { return U; }
+	inline int Taps() const { return K; }
+	inline int Stride() const { return stride; }
+
+	// Length of the prototype and its group delay in input samples, (n - 1) / 2 at U times the input rate for a
+	// linear phase design (what the designs here and lpf_design.m produce)
+	inline int Length() const { return length; }
+	inline double GroupDelay() const { return (length - 1) / 2.0 / U; }
+
+	// c_p[r] = h[p + (K - 1 - r) U], zero past the end of h and in the padding
+	inline const float* Phase(int p) const { return table + p * stride; }
+	inline const PolyPhase& Span(int p) const { return spans[p]; }
+};
+
+// Rational U/D resampler driven by the outputs: y[m] = sum_j h[mD - jU] x[j], the same as DigiResampler
+// Each output is one dot product of phase (mD mod U) with the last K inputs. The delay line is written twice
+// (at w and w + K) so the newest K samples are always contiguous and no index needs a modulo.
+class PolyResampler {
+private:
+	int U, D;
+	std::shared_ptr<const PolyFilter> bank;
+	float* line;
+	int w;     // next delay line slot
+	int phase; // mD - jU of the next output, relative to the newest input j
+
+	void init(int up, int down, std::shared_ptr<const PolyFilter> filter);
+
+public:
+	PolyResampler(int up, int down, Signal<float>* filter);
+	// Share a bank, up has to match its phase count (see DesignPolyFilter)
+	PolyResampler(int up, int down, std::shared_ptr<const PolyFilter> filter);
+	// Any ratio, the filter is designed at runtime (reduced by the GCD first) and shared through the cache
+	PolyResampler(int up, int down, double passband, double atten);
+	~PolyResampler();
+
+	PolyResampler(const PolyResampler& rhs) = delete;
+	PolyResampler& operator=(PolyResampler const& rhs) = delete;
+
+	inline int Up() const { return U; }
+	inline int Down() const { return D; }
+	inline const PolyFilter& Bank() const { return *bank; }
+
+	// Most outputs a single feed() can produce
+	inline int MaxOut() const { return (U + D - 1) / D; }
+	// Most outputs a process() of n inputs can produce
+	inline int MaxOut(int n) const { return (int)(((long long)n * U + D - 1) / D); }
+
+	// Push one input sample, writes the outputs it completes to out (at most MaxOut()) and returns their count
+	inline int feed(float xn, float* out) { return process(&xn, 1, out); }
+
+	// Push n input samples, writes the outputs they complete to out (at most MaxOut(n)) and returns their count
+	// No I/O and no allocation, the caller owns both buffers.
+	int process(const float* in, int n, float* out);
+
+	// Pick a stream up at input j0 as if inputs 0 .. j0 - 1 had been pushed: history holds the n inputs right
+	// before j0 (the last Bank().Taps() - 1 are enough, fewer only near the start of the stream)
+	void restart(long long j0, const float* history, int n);
+};
+
+// Decimation by 2 on a two phase bank (DesignHalfband), the same as PolyResampler(1, 2) with the prototype at half
+// gain: y[m] = 1/2 sum_i h[i] x[2m - i]. Even and odd inputs go to separate delay lines, each output dots the even
+// inputs with phase 0 and the odd ones with phase 1. For a halfband prototype one of the phases is a single tap,
+// so only the nonzero taps of the other are multiplied and the center tap adds one multiply by a delayed sample.
+class HalfbandDecimator {
+private:
+	std::shared_ptr<const PolyFilter> bank;
+	float* line;  // phase 0 line, then phase 1 line, K + stride floats each
+	int w[2];     // next slot of each line
+	int next;     // phase of the next input
+
+public:
+	// bank has to have 2 phases
+	HalfbandDecimator(std::shared_ptr<const PolyFilter> filter);
+	~HalfbandDecimator();
+
+	HalfbandDecimator(const HalfbandDecimator& rhs) = delete;
+	HalfbandDecimator& operator=(HalfbandDecimator const& rhs) = delete;
+
+	inline const PolyFilter& Bank() const { return *bank; }
+
+	// Most outputs a single feed() can produce
+	inline int MaxOut() const { return 1; }
+	// Most outputs a process() of n inputs can produce
+	inline int MaxOut(int n) const { return (n + 1) / 2; }
+
+	// Push one input sample, writes the output it completes to out (at most MaxOut()) and returns the count
+	inline int feed(float xn, float* out) { return process(&xn, 1, out); }
+
+	// Push n input samples, writes the outputs they complete to out (at most MaxOut(n)) and returns their count
+	int process(const float* in, int n, float* out);
+};
+
+// Minimum inputs per chunk of ResampleParallel, keeps the K - 1 samples of priming per chunk negligible
+#define RESAMPLE_CHUNK (1 << 15)
+
+// Offline resampling of a whole signal by up/down on the pool, returns the output count (MaxOut(n) of a resampler)
+// The input is cut into chunks starting on multiples of down (where the phase comes back to 0 and every chunk's
+// first output index is a whole number), each is primed with the filter length of input before it and run by
+// its own PolyResampler, and the outputs land straight in their place in out. Sample-identical to a single
+// PolyResampler::process over all of in.
+int ResampleParallel(int up, int down, std::shared_ptr<const PolyFilter> bank, const float* in, int n, float* out, ThreadPool& pool = ThreadPool::Shared());
+
+// PolyResampler for C interleaved channels, all channels step through the same phases so one phase update and one
+// coefficient row serve a whole frame. Frames sit in the delay line padded to P channels (padding stays zero).
+// Up to 4 channels (P = 1, 2, 4) the SIMD lanes run along the taps: every coefficient is repeated P times so a row
+// lines up with the interleaved window, and lane k ends up with channel k mod P. From 5 channels on (P a multiple
+// of 8) the lanes are the channels and each coefficient is broadcast against a frame.
+class MultiChannelResampler {
+private:
+	int U, D, C, P;
+	std::shared_ptr<const PolyFilter> bank;
+	float* raw;   // expanded rows, P = 2 or 4 only
+	float* table;
+	float* line;  // K + stride frames
+	float* sums;  // lane sums of one output frame
+	int w;
+	int phase;
+
+	void init(int up, int down, int channels, std::shared_ptr<const PolyFilter> filter);
+
+public:
+	MultiChannelResampler(int up, int down, int channels, Signal<float>* filter);
+	MultiChannelResampler(int up, int down, int channels, std::shared_ptr<const PolyFilter> filter);
+	MultiChannelResampler(int up, int down, int channels, double passband, double atten);
+	~MultiChannelResampler();
+
+	MultiChannelResampler(const MultiChannelResampler& rhs) = delete;
+	MultiChannelResampler& operator=(MultiChannelResampler const& rhs) = delete;
+
+	inline int Up() const { return U; }
+	inline int Down() const { return D; }
+	inline int Channels() const { return C; }
+	inline const PolyFilter& Bank() const { return *bank; }
+
+	// Most output frames a process() of n frames can produce
+	inline int MaxOut(int n) const { return (int)(((long long)n * U + D - 1) / D); }
+
+	// Push n interleaved frames (n * Channels() floats), writes the frames they complete to out (at most
+	// MaxOut(n)) and returns their count
+	int process(const float* in, int n, float* out);
+};
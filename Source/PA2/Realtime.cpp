@@ -0,0 +1,111 @@
+#include "Realtime.hpp"
+#include <chrono>
+#include <sstream>
+
+void LatencyHistogram::Record(long long ns) {
+	int b = 0;
+	while (b + 1 < LATENCY_BUCKETS && (ns >> (b + 1)) > 0) { ++b; }
+	counts[b].fetch_add(1, std::memory_order_relaxed);
+	if (ns > worst.load(std::memory_order_relaxed)) { worst.store(ns, std::memory_order_relaxed); }
+}
+
+void LatencyHistogram::Reset() {
+	for (int b = 0; b < LATENCY_BUCKETS; ++b) { counts[b] = 0; }
+	worst = 0;
+}
+
+unsigned long long LatencyHistogram::Count() const {
+	unsigned long long total = 0;
+	for (int b = 0; b < LATENCY_BUCKETS; ++b) { total += Bucket(b); }
+	return total;
+}
+
+long long LatencyHistogram::Quantile(double q) const {
+	unsigned long long total = Count();
+	unsigned long long seen = 0;
+	for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+		seen += Bucket(b);
+		if (total > 0 && seen >= q * total) { return 2LL << b; }
+	}
+	return Max();
+}
+
+unsigned long long LatencyHistogram::Above(long long ns) const {
+	unsigned long long total = 0;
+	for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+		if ((1LL << b) > ns) { total += Bucket(b); }
+	}
+	return total;
+}
+
+static std::string Duration(long long ns) {
+	std::ostringstream str;
+	if (ns >= 1000000000) { str << ns / 1000000000 << "s"; }
+	else if (ns >= 1000000) { str << ns / 1000000 << "ms"; }
+	else if (ns >= 1000) { str << ns / 1000 << "us"; }
+	else { str << ns << "ns"; }
+	return str.str();
+}
+
+std::string LatencyHistogram::Describe() const {
+	std::ostringstream str;
+	for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+		if (Bucket(b) == 0) { continue; }
+		str << "[" << Duration(b == 0 ? 0 : 1LL << b) << ", " << Duration(2LL << b) << ") " << Bucket(b) << std::endl;
+	}
+	return str.str();
+}
+
+RealtimeResampler::RealtimeResampler(int up, int down, std::shared_ptr<const PolyFilter> bank, int blockSize, int capacity)
+	: resampler(up, down, bank), input(blockSize * capacity), output(resampler.MaxOut(blockSize) * capacity) {
+	block = blockSize;
+	inBlock = new float[block];
+	outBlock = new float[resampler.MaxOut(block)];
+	dropped = 0;
+	overruns = 0;
+	stop = false;
+	thread = std::thread(&RealtimeResampler::run, this);
+}
+
+RealtimeResampler::~RealtimeResampler() {
+	stop.store(true, std::memory_order_release);
+	thread.join();
+	delete[] inBlock;
+	delete[] outBlock;
+}
+
+int RealtimeResampler::push(const float* in, int n) {
+	int count = input.Write(in, n);
+	if (count < n) { dropped.fetch_add(n - count, std::memory_order_relaxed); }
+	return count;
+}
+
+int RealtimeResampler::pop(float* out, int n) {
+	return output.Read(out, n);
+}
+
+void RealtimeResampler::run() {
+	int idle = 0;
+	while (!stop.load(std::memory_order_acquire)) {
+		if (input.Available() < block) {
+			// Spin a little for the next block, then back off so an idle stream doesn't hold a core
+			if (++idle < REALTIME_SPIN) {
+				std::this_thread::yield();
+			}
+			else {
+				std::this_thread::sleep_for(std::chrono::microseconds(REALTIME_SLEEP_US));
+			}
+			continue;
+		}
+		idle = 0;
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		input.Read(inBlock, block);
+		int count = resampler.process(inBlock, block, outBlock);
+		int written = output.Write(outBlock, count);
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+		if (written < count) { overruns.fetch_add(count - written, std::memory_order_relaxed); }
+		latency.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+	}
+}
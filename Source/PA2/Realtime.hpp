@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include "PolyFilter.hpp"
+#include "ring.hpp"
+
+// Power of two buckets of durations in ns, bucket b counts [2^b, 2^(b+1)) (bucket 0 also counts 0)
+#define LATENCY_BUCKETS 40
+
+// Histogram of per-block processing times, recorded by one thread and readable from any (relaxed counters, so
+// a reader may see a block in Count() a moment before it shows up in its bucket)
+class LatencyHistogram {
+private:
+	std::atomic<unsigned long long> counts[LATENCY_BUCKETS];
+	std::atomic<long long> worst;
+
+public:
+	LatencyHistogram() {
+		Reset();
+	}
+
+	LatencyHistogram(const LatencyHistogram& rhs) = delete;
+	LatencyHistogram& operator=(LatencyHistogram const& rhs) = delete;
+
+	void Record(long long ns);
+	void Reset();
+
+	unsigned long long Count() const;
+	inline unsigned long long Bucket(int b) const { return counts[b].load(std::memory_order_relaxed); }
+	inline long long Max() const { return worst.load(std::memory_order_relaxed); }
+
+	// Upper edge of the bucket holding the q quantile (0 .. 1), so a bound within a factor of 2
+	long long Quantile(double q) const;
+
+	// Blocks in buckets entirely above ns, e.g. the ones that certainly missed a deadline of ns
+	unsigned long long Above(long long ns) const;
+
+	// One line per nonempty bucket, e.g. "[4us, 8us) 1234"
+	std::string Describe() const;
+};
+
+// Polls before the processing thread starts sleeping when no block is ready, and how long it sleeps
+#define REALTIME_SPIN     64
+#define REALTIME_SLEEP_US 50
+
+// PolyResampler for a live capture -> process -> playback path
+// The producer pushes inputs into a lock-free ring, a dedicated thread resamples them in fixed blocks into a second
+// ring the consumer pops from. Everything is allocated up front, the audio path never allocates, locks or does
+// I/O. When a ring is full the samples that don't fit are dropped and counted instead of stalling either side.
+class RealtimeResampler {
+private:
+	PolyResampler resampler;
+	int block;
+	float* inBlock;
+	float* outBlock;
+	SpscRing<float> input;
+	SpscRing<float> output;
+	LatencyHistogram latency;
+	std::atomic<unsigned long long> dropped;  // inputs push() turned away, a live producer has no time to retry them
+	std::atomic<unsigned long long> overruns; // outputs the output ring had no room for
+	std::atomic<bool> stop;
+	std::thread thread;
+
+	void run();
+
+public:
+	// blockSize inputs per processing step, each ring holds capacity blocks (of inputs or of the outputs they make)
+	RealtimeResampler(int up, int down, std::shared_ptr<const PolyFilter> bank, int blockSize, int capacity = 8);
+	// Stops and joins the processing thread, a partial block left in the input ring is discarded
+	~RealtimeResampler();
+
+	RealtimeResampler(const RealtimeResampler& rhs) = delete;
+	RealtimeResampler& operator=(RealtimeResampler const& rhs) = delete;
+
+	// Producer side, queues up to n inputs and returns how many fit
+	int push(const float* in, int n);
+	// Consumer side, takes up to n outputs and returns how many were ready
+	int pop(float* out, int n);
+
+	inline int Block() const { return block; }
+
+	// Algorithmic delay in input samples: the filter's group delay, and that plus the block the processing thread
+	// waits to fill (scheduling and ring occupancy come on top, see Timing())
+	inline double GroupDelay() const { return resampler.Bank().GroupDelay(); }
+	inline double Delay() const { return GroupDelay() + block; }
+
+	// Processing time per block (ring read, resampling and ring write)
+	inline const LatencyHistogram& Timing() const { return latency; }
+
+	inline unsigned long long Dropped() const { return dropped.load(std::memory_order_relaxed); }
+	inline unsigned long long Overruns() const { return overruns.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,73 @@
+#include "ResampleService.hpp"
+#include <algorithm>
+#include <functional>
+
+ResampleService::~ResampleService() {
+	for (PolyResampler* s : streams) { delete s; }
+}
+
+int ResampleService::open(int up, int down, double passband, double atten) {
+	int g = GCD(up, down);
+	return open(up / g, down / g, DesignPolyFilter(up, down, passband, atten));
+}
+
+int ResampleService::open(int up, int down, std::shared_ptr<const PolyFilter> bank) {
+	PolyResampler* stream = new PolyResampler(up, down, bank);
+	if (unused.empty()) {
+		streams.push_back(stream);
+		return (int)streams.size() - 1;
+	}
+	int id = unused.back();
+	unused.pop_back();
+	streams[id] = stream;
+	return id;
+}
+
+void ResampleService::close(int stream) {
+	delete streams[stream];
+	streams[stream] = nullptr;
+	unused.push_back(stream);
+}
+
+int ResampleService::Size() const {
+	return (int)(streams.size() - unused.size());
+}
+
+void ResampleService::Process(StreamJob* jobs, int count, ThreadPool& pool) {
+	if (count == 0) { return; }
+
+	// Batch order by bank, then cut it into runs on one bank of about equal work (MACs), a few per thread
+	std::vector<int> order(count);
+	double total = 0;
+	for (int i = 0; i < count; ++i) {
+		order[i] = i;
+		const PolyResampler* s = streams[jobs[i].stream];
+		total += (double)s->MaxOut(jobs[i].n) * s->Bank().Stride();
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) -> bool {
+		// std::less, built-in < on pointers into different objects is unspecified
+		return std::less<const PolyFilter*>()(&streams[jobs[a].stream]->Bank(), &streams[jobs[b].stream]->Bank());
+	});
+
+	double target = total / (pool.Size() * 4);
+	std::vector<int> runs; // start of each run in order, plus the end
+	const PolyFilter* bank = nullptr;
+	double work = 0;
+	for (int i = 0; i < count; ++i) {
+		const PolyResampler* s = streams[jobs[order[i]].stream];
+		if (&s->Bank() != bank || work >= target) {
+			runs.push_back(i);
+			bank = &s->Bank();
+			work = 0;
+		}
+		work += (double)s->MaxOut(jobs[order[i]].n) * s->Bank().Stride();
+	}
+	runs.push_back(count);
+
+	pool.Run((int)runs.size() - 1, [&](int r) -> void {
+		for (int i = runs[r]; i < runs[r + 1]; ++i) {
+			StreamJob& job = jobs[order[i]];
+			job.produced = streams[job.stream]->process(job.in, job.n, job.out);
+		}
+	});
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "FilterDesign.hpp"
+#include "PolyFilter.hpp"
+#include "pool.hpp"
+
+// One stream's share of a ResampleService::Process batch
+struct StreamJob {
+	int stream;
+	const float* in;
+	int n;
+	float* out;   // room for MaxOut(stream, n) samples
+	int produced; // set by Process
+};
+
+// Many concurrent resampling streams over shared filter banks
+// A stream is only its delay line and phase (a PolyResampler) plus a reference to an immutable bank from the
+// design cache, so thousands of streams at a handful of ratios cost a handful of tables. Process() sorts a batch
+// by bank and hands each pool task a run of streams on the same bank, which keeps that table hot in cache while
+// the task walks its streams.
+// open(), close() and Process() are not meant to overlap, streams in one batch must be distinct.
+class ResampleService {
+private:
+	std::vector<PolyResampler*> streams;
+	std::vector<int> unused; // closed ids for reuse
+
+public:
+	ResampleService() {}
+	~ResampleService();
+
+	ResampleService(const ResampleService& rhs) = delete;
+	ResampleService& operator=(ResampleService const& rhs) = delete;
+
+	// New stream resampling by up/down with the DesignPolyFilter spec, returns its id
+	int open(int up, int down, double passband = DESIGN_PASSBAND, double atten = DESIGN_ATTENUATION);
+	// New stream on a given bank (up has to match its phase count)
+	int open(int up, int down, std::shared_ptr<const PolyFilter> bank);
+	void close(int stream);
+
+	inline int MaxOut(int stream, int n) const { return streams[stream]->MaxOut(n); }
+
+	// Open streams
+	int Size() const;
+
+	// Push every job's input through its stream, streams sharing a bank are grouped onto the same tasks
+	void Process(StreamJob* jobs, int count, ThreadPool& pool = ThreadPool::Shared());
+};
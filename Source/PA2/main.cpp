@@ -1,26 +1,32 @@
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include "fir.hpp"
 #include "signal.hpp"
+#include "PolyFilter.hpp"
+#include "ResampleService.hpp"
 
 class DigiResampler {
 private:
 	int U, D, N;
 	Signal<float>* h;
 	float* buff;
-
-	std::ofstream* fout;
+	FirSymmetry symmetry;
 
 	int buff_i, y_i;
 
 public:
-	DigiResampler(int up, int down, Signal<float>* filter, std::ofstream* file) {
+	DigiResampler(int up, int down, Signal<float>* filter) {
 		U = up;
 		D = down;
 		h = filter;
 		N = h->N();
 		buff = new float[N]();
 		buff_i = y_i = 0;
-		fout = file;
+
+		std::vector<float> taps(N);
+		for (int i = 0; i < N; ++i) { taps[i] = h->Get(i); }
+		symmetry = FirDetectSymmetry(taps.data(), N);
 	}
 	~DigiResampler() {
 		delete[] buff;
@@ -29,10 +35,29 @@ public:
 	DigiResampler(const DigiResampler& rhs) = delete;
 	DigiResampler& operator=(DigiResampler const& rhs) = delete;
 
-	void feed(float xn) {
-		// Convolve xn
-		for (int i = 0; i < N; ++i) {
-			buff[(buff_i + i) % N] += xn * h->Get(i);
+	// Most outputs n inputs can produce
+	inline int MaxOut(int n) const { return (int)(((long long)n * U + D - 1) / D); }
+
+	// Push one input sample, writes the outputs it completes to out and returns their count
+	int feed(float xn, float* out) {
+		int count = 0;
+
+		// Convolve xn, a linear phase filter scatters each product to both mirrored taps
+		if (symmetry == FirSymmetry::None) {
+			for (int i = 0; i < N; ++i) {
+				buff[(buff_i + i) % N] += xn * h->Get(i);
+			}
+		}
+		else {
+			float sign = symmetry == FirSymmetry::Odd ? -1.0f : 1.0f;
+			for (int i = 0; i < N / 2; ++i) {
+				float v = xn * h->Get(i);
+				buff[(buff_i + i) % N] += v;
+				buff[(buff_i + N - 1 - i) % N] += sign * v;
+			}
+			if (N & 1) {
+				buff[(buff_i + N / 2) % N] += xn * h->Get(N / 2);
+			}
 		}
 
 		// Upsample (buff_i increments to simulate inserting 0's)
@@ -42,8 +67,7 @@ public:
 		// Downsample
 		while (y_i < y_f) {
 			// Output buff[y_i % N]
-			float y_o = buff[y_i % N];
-			fout->write((char*)(&y_o), sizeof(float));
+			out[count++] = buff[y_i % N];
 
 			for (int d = 0; d < D; ++d) {
 				buff[(y_i + d) % N] = 0;
@@ -54,102 +78,52 @@ public:
 		}
 		// Done here so overflow doesn't prevent us from knowing when to stop
 		y_i %= N;
+		return count;
 	}
-};
 
-class PolyResampler {
-private:
-	struct PolyFilter {
-		float* Filter;
-		float* Buffer;
-	};
-	PolyFilter* R;
-	int U, D, Rn;
-	int Ri;
-
-	std::ofstream* fout;
-
-	inline PolyFilter* GetFilter(int u, int d) {
-		if (u < 0 || d < 0 || u < U || d < D) {
-			return nullptr;
+	// Block of n inputs, out needs room for MaxOut(n) samples, returns the count written
+	int process(const float* in, int n, float* out) {
+		int count = 0;
+		for (int i = 0; i < n; ++i) {
+			count += feed(in[i], out + count);
 		}
-		return &R[u*D + d];
+		return count;
 	}
+};
 
-	PolyResampler(const PolyResampler& rhs) = delete;
-	PolyResampler& operator=(PolyResampler const& rhs) = delete;
-
-public:
-	~PolyResampler() {
-		for (int u = 0; u < U; ++u) {
-			for (int d = 0; d < D; ++d) {
-				PolyFilter* Rud = &R[u*D + d];
-				delete[] Rud->Buffer;
-				delete[] Rud->Filter;
-			}
-		}
-		delete[] R;
-	}
-
-	// In this case, I believe (naive approach) it will be more cache efficient to have each Rud filter be contiguous
-	PolyResampler(int up, int down, Signal<float>* filter, std::ofstream* file) {
-		fout = file;
-		U = up;
-		D = down;
-		Rn = filter->N() / 6;
-		R = new PolyFilter[U * D];
-		for (int u = 0; u < U; ++u) {
-			for (int d = 0; d < D; ++d) {
-				PolyFilter* Rud = &R[u*D + d];
-				Rud->Buffer = new float[Rn]();
-				Rud->Filter = new float[Rn];
-
-				// Generate the smaller filters
-				for (int n = 0; n < Rn; ++n) {
-					Rud->Filter[n] = filter->Get((n * U * D) + (u * D) + d);
-				}
-			}
-		}
-		Ri = 0;
-	}
-
-	void feed(float xn) {
-		int d = Ri % D;
-
-		// Feed xn to all R-filters at the d-offset
-		for (int u = 0; u < U; ++u) {
-			PolyFilter* Rud = &R[u*D + d];
-
-			// Convolve xn
-			for (int n = 0; n < Rn; ++n) {
-				Rud->Buffer[(Ri + n) % Rn] += xn * Rud->Filter[n];
-			}
-		}
+#define INTERP_UP       3
+#define INTERP_DOWN     2
 
-		int nextRi = (Ri + 1) % Rn;
-		d = nextRi % D;
-
-		// After x[0], x[1], ..., x[D] has been feed through
-		if (d == 0) {
-			// Output y[0], y[1], ..., y[U]
-			for (int u = 0; u < U; ++u) {
-				float Run = 0;
-				for (int d = 0; d < D; ++d) {
-					PolyFilter* Rud = &R[u*D + d];
-					Run += Rud->Buffer[Ri];
-					Rud->Buffer[Ri] = 0;
-				}
-				fout->write((char*)(&Run), sizeof(float));
-			}
-		}
+// Read a .bin signal (int count, then the floats)
+static bool ReadSamples(const char* file, std::vector<float>& x) {
+	std::ifstream fin(file, std::ios::binary | std::ios::in);
+	if (!fin) { return false; }
+	int N;
+	fin.read((char*)&N, sizeof(int));
+	x.resize(N);
+	fin.read((char*)x.data(), sizeof(float) * N);
+	return true;
+}
 
-		Ri = nextRi;
-	}
+// Write raw samples in one go
+static void WriteSamples(const char* file, const std::vector<float>& y, int n) {
+	std::ofstream fout(file, std::ios::binary | std::ios::out);
+	fout.write((const char*)y.data(), sizeof(float) * n);
+}
 
+// Inputs and the outputs of each resampler
+struct ResampleFiles {
+	const char* input;
+	const char* digOutput;
+	const char* polOutput;
 };
 
-#define INTERP_UP       3
-#define INTERP_DOWN     2
+static const ResampleFiles files[] = {
+	{ "ghostbustersray.bin", "digInterp.bin", "polInterp.bin" }, // Ghostbusters
+	{ "c16.bin", "digc16.bin", "polc16.bin" },                   // 1/16 freq cosine
+	{ "c8.bin", "digc8.bin", "polc8.bin" },                      // 1/8 freq cosine
+	{ "c4.bin", "digc4.bin", "polc4.bin" },                      // 1/4 freq cosine
+};
 
 int main() {
 	int err;
@@ -164,85 +138,42 @@ int main() {
 		return -1;
 	}
 
-	int N;
-	float* x;
-
-	// Ghostbusters
-	std::ifstream fin("ghostbustersray.bin", std::ios::binary | std::ios::in);
-	fin.read((char*)&N, sizeof(int));
-	x = new float[N];
-	fin.read((char*)x, sizeof(float) * N);
-	fin.close();
-
-	std::ofstream fDigOut("digInterp.bin", std::ios::binary | std::ios::out);
-	std::ofstream fPolOut("polInterp.bin", std::ios::binary | std::ios::out);
-	DigiResampler DigInterp(INTERP_UP, INTERP_DOWN, h, &fDigOut);
-	PolyResampler PolInterp(INTERP_UP, INTERP_DOWN, h, &fPolOut);
-
-	for (int i = 0; i < N; ++i) {
-		DigInterp.feed(x[i]);
-		PolInterp.feed(x[i]);
+	const int count = sizeof(files) / sizeof(files[0]);
+	std::vector<float> x[count];
+	std::vector<float> y[count];
+	for (int i = 0; i < count; ++i) {
+		if (!ReadSamples(files[i].input, x[i])) {
+			std::cout << "Unable to read " << files[i].input << std::endl;
+			delete h;
+			return ERROR_BIN_FILE;
+		}
 	}
-	fDigOut.close();
-	fPolOut.close();
-	delete x;
 
-	// 1/16 freq cosine
-	fin.open("c16.bin", std::ios::binary | std::ios::in);
-	fin.read((char*)&N, sizeof(int));
-	x = new float[N];
-	fin.read((char*)x, sizeof(float) * N);
-	fin.close();
-
-	fDigOut.open("digc16.bin", std::ios::binary | std::ios::out);
-	fPolOut.open("polc16.bin", std::ios::binary | std::ios::out);
-	DigiResampler DigC16(INTERP_UP, INTERP_DOWN, h, &fDigOut);
-	PolyResampler PolC16(INTERP_UP, INTERP_DOWN, h, &fPolOut);
-	for (int i = 0; i < N; ++i) {
-		DigC16.feed(x[i]);
-		PolC16.feed(x[i]);
+	// Reference resampler, one input after another
+	for (int i = 0; i < count; ++i) {
+		DigiResampler dig(INTERP_UP, INTERP_DOWN, h);
+		y[i].resize(dig.MaxOut((int)x[i].size()));
+		WriteSamples(files[i].digOutput, y[i], dig.process(x[i].data(), (int)x[i].size(), y[i].data()));
 	}
-	fDigOut.close();
-	fPolOut.close();
-	delete x;
 
-	// 1/8 freq cosine
-	fin.open("c8.bin", std::ios::binary | std::ios::in);
-	fin.read((char*)&N, sizeof(int));
-	x = new float[N];
-	fin.read((char*)x, sizeof(float) * N);
-	fin.close();
-
-	fDigOut.open("digc8.bin", std::ios::binary | std::ios::out);
-	fPolOut.open("polc8.bin", std::ios::binary | std::ios::out);
-	DigiResampler DigC8(INTERP_UP, INTERP_DOWN, h, &fDigOut);
-	PolyResampler PolC8(INTERP_UP, INTERP_DOWN, h, &fPolOut);
-	for (int i = 0; i < N; ++i) {
-		DigC8.feed(x[i]);
-		PolC8.feed(x[i]);
+	// Polyphase, every input is a stream on one shared bank and they all run as one batch on the pool
+	std::vector<float> taps(h->N());
+	for (int i = 0; i < h->N(); ++i) { taps[i] = h->Get(i); }
+	std::shared_ptr<const PolyFilter> bank = std::make_shared<const PolyFilter>(INTERP_UP, taps.data(), h->N());
+
+	ResampleService service;
+	StreamJob jobs[count];
+	for (int i = 0; i < count; ++i) {
+		jobs[i].stream = service.open(INTERP_UP, INTERP_DOWN, bank);
+		jobs[i].in = x[i].data();
+		jobs[i].n = (int)x[i].size();
+		y[i].resize(service.MaxOut(jobs[i].stream, jobs[i].n));
+		jobs[i].out = y[i].data();
 	}
-	fDigOut.close();
-	fPolOut.close();
-	delete x;
-
-	// 1/4 freq cosine
-	fin.open("c4.bin", std::ios::binary | std::ios::in);
-	fin.read((char*)&N, sizeof(int));
-	x = new float[N];
-	fin.read((char*)x, sizeof(float) * N);
-	fin.close();
-
-	fDigOut.open("digc4.bin", std::ios::binary | std::ios::out);
-	fPolOut.open("polc4.bin", std::ios::binary | std::ios::out);
-	DigiResampler DigC4(INTERP_UP, INTERP_DOWN, h, &fDigOut);
-	PolyResampler PolC4(INTERP_UP, INTERP_DOWN, h, &fPolOut);
-	for (int i = 0; i < N; ++i) {
-		DigC4.feed(x[i]);
-		PolC4.feed(x[i]);
+	service.Process(jobs, count);
+	for (int i = 0; i < count; ++i) {
+		WriteSamples(files[i].polOutput, y[i], jobs[i].produced);
 	}
-	fDigOut.close();
-	fPolOut.close();
-	delete x;
 
 	delete h;
 	return 0;
@@ -0,0 +1,85 @@
+#include "arena.hpp"
+#include <cstdlib>
+#include <new>
+
+static inline size_t RoundUp(size_t bytes) {
+	return (bytes + STORAGE_ALIGN - 1) / STORAGE_ALIGN * STORAGE_ALIGN;
+}
+
+void* AlignedAlloc(size_t bytes) {
+	bytes = RoundUp(bytes > 0 ? bytes : 1);
+#if defined(_WIN32)
+	void* p = _aligned_malloc(bytes, STORAGE_ALIGN);
+#else
+	void* p = nullptr;
+	if (posix_memalign(&p, STORAGE_ALIGN, bytes) != 0) { p = nullptr; }
+#endif
+	if (p == nullptr) { throw std::bad_alloc(); }
+	return p;
+}
+
+void AlignedFree(void* p) {
+#if defined(_WIN32)
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+static thread_local BufferArena* current = nullptr;
+
+BufferArena* BufferArena::Current() {
+	return current;
+}
+
+void BufferArena::SetCurrent(BufferArena* arena) {
+	current = arena;
+}
+
+BufferArena::BufferArena(size_t limit) : held(0), limit(limit) {}
+
+BufferArena::~BufferArena() {
+	Trim();
+}
+
+void* BufferArena::Acquire(size_t bytes) {
+	bytes = RoundUp(bytes > 0 ? bytes : 1);
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		auto it = free.find(bytes);
+		if (it != free.end() && !it->second.empty()) {
+			void* p = it->second.back();
+			it->second.pop_back();
+			held -= bytes;
+			return p;
+		}
+	}
+	return AlignedAlloc(bytes);
+}
+
+void BufferArena::Release(void* p, size_t bytes) {
+	bytes = RoundUp(bytes > 0 ? bytes : 1);
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (limit == 0 || held + bytes <= limit) {
+			free[bytes].push_back(p);
+			held += bytes;
+			return;
+		}
+	}
+	AlignedFree(p);
+}
+
+size_t BufferArena::Held() {
+	std::lock_guard<std::mutex> guard(lock);
+	return held;
+}
+
+void BufferArena::Trim() {
+	std::lock_guard<std::mutex> guard(lock);
+	for (auto& size : free) {
+		for (void* p : size.second) { AlignedFree(p); }
+	}
+	free.clear();
+	held = 0;
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Alignment of Image and Signal storage (and of every Image row), one cache line and one AVX-512 register
+#define STORAGE_ALIGN 64
+
+// STORAGE_ALIGN aligned heap blocks
+void* AlignedAlloc(size_t bytes);
+void AlignedFree(void* p);
+
+// Recycles the pixel and sample buffers of pipeline intermediates
+// Released blocks are kept by size and handed out again to the next Acquire() of that size, so a pipeline that
+// makes the same images every frame stops touching the heap for them once the first frame has run. Image and
+// Signal take their storage from the arena installed on the constructing thread (see ArenaScope) and give it
+// back when they're destroyed, on whatever thread that is.
+class BufferArena {
+private:
+	std::mutex lock;
+	std::map<size_t, std::vector<void*>> free;
+	size_t held, limit;
+
+public:
+	// limit caps the bytes kept for reuse (0 for no cap), blocks released past it go back to the heap
+	BufferArena(size_t limit = 0);
+	~BufferArena();
+
+	BufferArena(const BufferArena& rhs) = delete;
+	BufferArena& operator=(BufferArena const& rhs) = delete;
+
+	// bytes is rounded up to STORAGE_ALIGN, the block is aligned to it
+	void* Acquire(size_t bytes);
+	void Release(void* p, size_t bytes);
+
+	// Bytes held for reuse
+	size_t Held();
+	// Hand every held block back to the heap
+	void Trim();
+
+	// Arena new storage comes from on this thread, nullptr for the heap
+	static BufferArena* Current();
+	static void SetCurrent(BufferArena* arena);
+};
+
+// Installs an arena on this thread for its lifetime, restoring the previous one after
+class ArenaScope {
+private:
+	BufferArena* previous;
+
+public:
+	ArenaScope(BufferArena& arena) {
+		previous = BufferArena::Current();
+		BufferArena::SetCurrent(&arena);
+	}
+	~ArenaScope() {
+		BufferArena::SetCurrent(previous);
+	}
+
+	ArenaScope(const ArenaScope& rhs) = delete;
+	ArenaScope& operator=(ArenaScope const& rhs) = delete;
+};
+
+// Storage for Image and Signal, from the current arena if there is one
+// Returns the arena the block came from so the owner can hand it back to the right place.
+inline void* StorageAlloc(size_t bytes, BufferArena*& arena) {
+	arena = BufferArena::Current();
+	return arena != nullptr ? arena->Acquire(bytes) : AlignedAlloc(bytes);
+}
+inline void StorageFree(void* p, size_t bytes, BufferArena* arena) {
+	if (p == nullptr) { return; }
+	if (arena != nullptr) { arena->Release(p, bytes); }
+	else { AlignedFree(p); }
+}
+
+// Scratch array for the intermediates of one call (float copies of the input, spectra, ...), STORAGE_ALIGN aligned
+// and taken from the current arena like Image storage, so steady-state frames don't go to the heap for them either.
+// Elements are zeroed by the sized constructor, after resize() they are unspecified (for buffers that are
+// overwritten next). T has to be trivially copyable.
+template<typename T>
+class ArenaBuffer {
+private:
+	T* buf;
+	size_t count;
+	BufferArena* arena;
+
+	inline void clean() {
+		StorageFree(buf, sizeof(T) * count, arena);
+		buf = nullptr;
+		count = 0;
+		arena = nullptr;
+	}
+	inline void take(ArenaBuffer<T>& rhs) {
+		buf = rhs.buf;
+		count = rhs.count;
+		arena = rhs.arena;
+		rhs.buf = nullptr;
+		rhs.count = 0;
+		rhs.arena = nullptr;
+	}
+
+public:
+	ArenaBuffer() : buf(nullptr), count(0), arena(nullptr) {}
+	explicit ArenaBuffer(size_t n) : buf(nullptr), count(0), arena(nullptr) {
+		resize(n);
+		std::fill(buf, buf + n, T());
+	}
+	ArenaBuffer(ArenaBuffer<T>&& rhs) { take(rhs); }
+	ArenaBuffer<T>& operator=(ArenaBuffer<T>&& rhs) {
+		if (this != &rhs) {
+			clean();
+			take(rhs);
+		}
+		return *this;
+	}
+	~ArenaBuffer() { clean(); }
+
+	ArenaBuffer(const ArenaBuffer& rhs) = delete;
+	ArenaBuffer& operator=(ArenaBuffer const& rhs) = delete;
+
+	inline void resize(size_t n) {
+		if (n == count) { return; }
+		clean();
+		if (n > 0) {
+			buf = (T*)StorageAlloc(sizeof(T) * n, arena);
+			count = n;
+		}
+	}
+
+	inline size_t size() const { return count; }
+	inline T* data() { return buf; }
+	inline const T* data() const { return buf; }
+	inline T& operator[](size_t i) { return buf[i]; }
+	inline const T& operator[](size_t i) const { return buf[i]; }
+	inline T* begin() { return buf; }
+	inline T* end() { return buf + count; }
+	inline const T* begin() const { return buf; }
+	inline const T* end() const { return buf + count; }
+};
@@ -1,7 +1,87 @@
 #pragma once
-#include <thread>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <string>
+#include <vector>
+#include "arena.hpp"
+#include "fft.hpp"
+#include "fir.hpp"
 #include "image.hpp"
+#include "pool.hpp"
+#include "separable.hpp"
 #include "signal.hpp"
+#include "simd.hpp"
+
+// Output window of a convolution
+// Full is the whole (MI+MF-1) x (NI+NF-1) result, Same is MI x NI centred on the image (tails trimmed by
+// ConvTailM/ConvTailN of the filter) and Valid is only the outputs whose taps all land inside the image
+enum class ConvMode {
+	Full,
+	Same,
+	Valid,
+};
+
+// Size and origin (within the full output) of the window mode selects along one axis
+inline void ConvWindow(ConvMode mode, int MI, int MF, int& MO, int& M0) {
+	switch (mode) {
+		case ConvMode::Full:
+			MO = MI + MF - 1;
+			M0 = 0;
+			break;
+		case ConvMode::Same:
+			MO = MI;
+			M0 = MF / 2; // ConvTailM / ConvTailN
+			break;
+		case ConvMode::Valid:
+			MO = MI - MF + 1 > 0 ? MI - MF + 1 : 0;
+			M0 = MF - 1;
+			break;
+	}
+}
+
+enum class Conv2DMethod {
+	Direct,
+	Folded, // Direct with the mirrored taps of each filter row pre-added
+	FFT,
+	Separable,
+	Fixed,
+};
+
+// Copy an image into a row-major float buffer (a std::vector<float> or an ArenaBuffer<float>)
+template<typename T, typename Buffer>
+void Conv2DFloat(Image<T>* image, Buffer& buf) {
+	int MI = image->M();
+	int NI = image->N();
+	buf.resize(MI * NI);
+	for (int n = 0; n < NI; ++n) {
+		const T* row = image->Row(n);
+		for (int m = 0; m < MI; ++m) {
+			buf[n * MI + m] = (float)row[m];
+		}
+	}
+}
+
+// Cost model shared by Conv2DPlan and Conv2DBank, in multiply-adds per the generic direct loop
+// The unrolled kernels keep the coefficients in registers and pairs of mirrored taps share a multiply, measured at
+// about these fractions of the generic loop
+#define CONV_FIXED_COST  0.7
+#define CONV_FOLDED_COST 0.75
+
+// One real 2D transform of PQ points
+inline double Conv2DTransformCost(double PQ) {
+	return 2.5 * PQ * log2(PQ);
+}
+// Filter sizes with a Conv2DFixed specialization
+inline bool Conv2DHasFixed(int MF, int NF) {
+	return MF == NF && (MF == 3 || MF == 5 || MF == 7);
+}
+// Cheapest direct path for a filter, direct is its generic cost
+inline double Conv2DDirectCost(double direct, int MF, int NF, FirSymmetry symmetry) {
+	if (Conv2DHasFixed(MF, NF)) { return CONV_FIXED_COST * direct; }
+	if (symmetry != FirSymmetry::None) { return CONV_FOLDED_COST * direct; }
+	return direct;
+}
 
 // Struct helper for Conv2D
 template<typename T1, typename T2>
@@ -11,10 +91,56 @@ public:
 	Image<T2>* F;
 	int MI, NI;
 	int MF, NF;
-	int M, N;
+	int M, N;       // full output size
+	int MO, NO;     // requested output window size
+	int M0, N0;     // window origin within the full output
+	ConvMode mode;
+	Conv2DMethod method;
+	FirSymmetry symmetry; // of the filter rows, for Folded
+	SeparableKernel sep;
 	Image<float>* out;
 
-	Conv2DPlan(Image<T1>* image, Image<T2>* filter) {
+	// Float copies of the image and filter (row-major, MI and MF wide) so the inner loops use raw pointers
+	ArenaBuffer<float> in, f;
+
+	// Full-output coordinates whose taps all land inside the image, [IM0, IM1) x [IN0, IN1), the rest is border
+	int IM0, IM1, IN0, IN1;
+
+	// Transform size that keeps circular wrap-around out of the output window
+	inline int FFTSizeM() const {
+		return FFT::FastSize(M0 + MO > M - M0 ? M0 + MO : M - M0);
+	}
+	inline int FFTSizeN() const {
+		return FFT::FastSize(N0 + NO > N - N0 ? N0 + NO : N - N0);
+	}
+
+	// Rough operation counts used to pick between the direct and frequency domain paths
+	// Direct is one MAC per tap per output pixel, FFT is two forward and one inverse real 2D transform plus the
+	// pointwise product
+	inline double DirectCost() const {
+		return (double)MO * NO * MF * NF;
+	}
+	inline double FFTCost() const {
+		double PQ = (double)FFTSizeM() * FFTSizeN();
+		return 3 * Conv2DTransformCost(PQ) + 3 * PQ;
+	}
+	inline double FoldedCost() const {
+		return CONV_FOLDED_COST * DirectCost();
+	}
+	inline bool HasFixed() const {
+		return Conv2DHasFixed(MF, NF);
+	}
+	inline double FixedCost() const {
+		return CONV_FIXED_COST * DirectCost();
+	}
+	// Separable is a horizontal pass over the input rows then a vertical pass, per term
+	// (plus a write and a read of the intermediate per pass)
+	inline double SeparableCost(int rank) const {
+		return (double)rank * ((double)MO * NI * (MF + 2) + (double)MO * NO * (NF + 2));
+	}
+
+	// rankError > 0 allows a truncated sum of separable terms with that relative (Frobenius) error
+	Conv2DPlan(Image<T1>* image, Image<T2>* filter, ConvMode outMode = ConvMode::Full, double rankError = 0) {
 		I = image; F = filter;
 
 		MI = I->M();
@@ -26,69 +152,644 @@ public:
 		M = MI + MF - 1;
 		N = NI + NF - 1;
 
-		out = new Image<float>(M, N);
+		mode = outMode;
+		ConvWindow(mode, MI, MF, MO, M0);
+		ConvWindow(mode, NI, NF, NO, N0);
+
+		Conv2DFloat(I, in);
+		Conv2DFloat(F, f);
+		symmetry = FirDetectSymmetry(f.data(), MF, NF);
+
+		IM0 = MF - 1;
+		IM1 = MI > IM0 ? MI : IM0;
+		IN0 = NF - 1;
+		IN1 = NI > IN0 ? NI : IN0;
+
+		double cost = DirectCost();
+		method = Conv2DMethod::Direct;
+		if (symmetry != FirSymmetry::None) {
+			cost = FoldedCost();
+			method = Conv2DMethod::Folded;
+		}
+		if (HasFixed()) {
+			cost = FixedCost();
+			method = Conv2DMethod::Fixed;
+		}
+		if (FFTCost() < cost) {
+			cost = FFTCost();
+			method = Conv2DMethod::FFT;
+		}
+
+		// Only pay for the SVD when even a single separable term would beat the other paths
+		if (SeparableCost(1) < cost) {
+			int maxRank = 1;
+			while (maxRank < MF && SeparableCost(maxRank + 1) < cost) { ++maxRank; }
+			double tolerance = rankError > SEPARABLE_EXACT ? rankError : SEPARABLE_EXACT;
+			if (Separate(f.data(), MF, NF, tolerance, maxRank, sep)) {
+				method = Conv2DMethod::Separable;
+			}
+		}
+
+		out = new Image<float>(MO, NO);
+	}
+
+	// Output row for full-output row n
+	inline float* OutRow(int n) {
+		return out->Row(n - N0) - M0;
 	}
 };
 
-// Thread routine for Multithreading in Opimization 2 (compare loop with O1Convolve2D)
+// FFT2D passes split across the pool (row passes are handed out in pairs)
+inline void FFT2DForward(const FFT2D& fft, const float* in, int w, int h, int ld, cpx* spec, ThreadPool& pool) {
+	pool.Rows((fft.Height() + 1) / 2, [&](int p0, int p1) -> void {
+		fft.ForwardRows(in, w, h, ld, spec, 2 * p0, 2 * p1 < fft.Height() ? 2 * p1 : fft.Height());
+	});
+	pool.Rows(fft.SpecWidth(), [&](int k0, int k1) -> void {
+		fft.ForwardCols(spec, k0, k1);
+	});
+}
+inline void FFT2DInverse(const FFT2D& fft, cpx* spec, float* out, int m0, int n0, int w, int h, int ld, ThreadPool& pool) {
+	pool.Rows(fft.SpecWidth(), [&](int k0, int k1) -> void {
+		fft.InverseCols(spec, k0, k1);
+	});
+	pool.Rows((h + 1) / 2, [&](int p0, int p1) -> void {
+		fft.InverseRows(spec, out, m0, n0, w, h, ld, 2 * p0, 2 * p1);
+	});
+}
+
+// Frequency domain convolution, zero padded to fast transform sizes (at least M x N so nothing wraps)
 template<typename T1, typename T2>
-void Conv2DThread(Conv2DPlan<T1, T2>* plan, int n0, int n1) {
-	if (n1 > plan->N) { n1 = plan->N; }
-	for (int n = n0; n < n1; ++n) {
-		for (int m = 0; m < plan->M; ++m) {
-			float sum = 0;
-			for (int k = 0; k <= n && k < plan->NF; ++k) {
-				for (int l = 0; l <= m && l < plan->MF; ++l) {
-					sum += (float)plan->F->Get(l, k) * plan->I->Get(m - l, n - k);
+void Conv2DFFT(Conv2DPlan<T1, T2>* plan, ThreadPool& pool) {
+	FFT2D fft(plan->FFTSizeM(), plan->FFTSizeN());
+
+	ArenaBuffer<cpx> SI(fft.SpecLength());
+	ArenaBuffer<cpx> SF(fft.SpecLength());
+
+	FFT2DForward(fft, plan->in.data(), plan->MI, plan->NI, plan->MI, SI.data(), pool);
+	FFT2DForward(fft, plan->f.data(), plan->MF, plan->NF, plan->MF, SF.data(), pool);
+
+	pool.Rows(fft.Height(), [&](int q0, int q1) -> void {
+		for (int i = q0 * fft.SpecWidth(); i < q1 * fft.SpecWidth(); ++i) {
+			SI[i] *= SF[i];
+		}
+	});
+
+	if (plan->MO == 0 || plan->NO == 0) { return; }
+	FFT2DInverse(fft, SI.data(), plan->out->Row(0), plan->M0, plan->N0, plan->MO, plan->NO, plan->out->Stride(), pool);
+}
+
+// Sum of separable terms, each a horizontal 1D pass over the input rows followed by a vertical 1D pass
+// Only the columns and rows of the output window are computed
+template<typename T1, typename T2>
+void Conv2DSeparable(Conv2DPlan<T1, T2>* plan, ThreadPool& pool) {
+	int MI = plan->MI, NI = plan->NI;
+	int MF = plan->MF, NF = plan->NF;
+	int MO = plan->MO, NO = plan->NO;
+	int M0 = plan->M0, N0 = plan->N0;
+
+	const ArenaBuffer<float>& in = plan->in;
+	ArenaBuffer<float> tmp((size_t)MO * NI);
+
+	// Columns [a, b) of the window have every horizontal tap inside the row
+	int a = M0 > MF - 1 ? M0 : MF - 1;
+	int b = M0 + MO < MI ? M0 + MO : MI;
+
+	for (int r = 0; r < plan->sep.Rank(); ++r) {
+		const float* row = plan->sep.rows[r].data();
+		const float* col = plan->sep.cols[r].data();
+		FirSymmetry rowSymmetry = FirDetectSymmetry(row, MF);
+
+		// Horizontal, interior columns go through the SIMD row kernel
+		pool.Rows(NI, [&](int n0, int n1) -> void {
+			for (int n = n0; n < n1; ++n) {
+				const float* src = &in[n * MI];
+				float* dst = &tmp[n * MO] - M0;
+				for (int m = M0; m < M0 + MO; ++m) {
+					if (m == a && a < b) {
+						if (rowSymmetry != FirSymmetry::None) {
+							Conv2DRowSym(dst + m, src + m, 0, row, MF, 1, FirSign(rowSymmetry), b - a);
+						}
+						else {
+							Conv2DRow(dst + m, src + m, 0, row, MF, 1, b - a);
+						}
+						m = b - 1;
+						continue;
+					}
+					int l0 = m - MI + 1 > 0 ? m - MI + 1 : 0;
+					int l1 = m < MF - 1 ? m : MF - 1;
+					float sum = 0;
+					for (int l = l0; l <= l1; ++l) {
+						sum += row[l] * src[m - l];
+					}
+					dst[m] = sum;
 				}
 			}
-			plan->out->Set(m, n, sum);
-		}
+		});
+
+		// Vertical, likewise for the rows with every tap inside the image (later terms accumulate through a row buffer)
+		pool.Rows(NO, [&](int n0, int n1) -> void {
+			std::vector<float> acc(r > 0 ? MO : 0);
+			for (int n = N0 + n0; n < N0 + n1; ++n) {
+				float* dst = plan->out->Row(n - N0);
+				if (n >= NF - 1 && n < NI) {
+					float* sum = r > 0 ? acc.data() : dst;
+					Conv2DRow(sum, &tmp[n * MO], MO, col, 1, NF, MO);
+					if (r > 0) {
+						for (int m = 0; m < MO; ++m) { dst[m] += sum[m]; }
+					}
+					continue;
+				}
+				int k0 = n - NI + 1 > 0 ? n - NI + 1 : 0;
+				int k1 = n < NF - 1 ? n : NF - 1;
+				for (int k = k0; k <= k1; ++k) {
+					const float* src = &tmp[(n - k) * MO];
+					float c = col[k];
+					for (int m = 0; m < MO; ++m) {
+						dst[m] += c * src[m];
+					}
+				}
+			}
+		});
 	}
 }
 
-// The number of threads to use for convolution (divided roughly equally, the last one may be slightly less workload)
-#define CONV_POOL_SIZE 10
+// Border outputs dst[m0 .. m1) of full-output row n, taps that fall outside the image are skipped (zero padding)
+inline void Conv2DBorderRow(float* dst, const float* in, int MI, int NI, const float* f, int MF, int NF, int m0, int m1, int n) {
+	int k0 = n - NI + 1 > 0 ? n - NI + 1 : 0;
+	int k1 = n < NF - 1 ? n : NF - 1;
+	for (int m = m0; m < m1; ++m) {
+		int l0 = m - MI + 1 > 0 ? m - MI + 1 : 0;
+		int l1 = m < MF - 1 ? m : MF - 1;
+		float sum = 0;
+		for (int k = k0; k <= k1; ++k) {
+			const float* src = &in[(n - k) * MI + m];
+			const float* fk = &f[k * MF];
+			for (int l = l0; l <= l1; ++l) {
+				sum += fk[l] * src[-l];
+			}
+		}
+		dst[m] = sum;
+	}
+}
 
+// m0, m1 and n are full-output coordinates
 template<typename T1, typename T2>
-Image<float>* Conv2D(Image<T1>* image, Image<T2>* filter) {
-	Conv2DPlan<T1, T2> plan(image, filter);
+void Conv2DBorder(Conv2DPlan<T1, T2>* plan, int m0, int m1, int n) {
+	Conv2DBorderRow(plan->OutRow(n), plan->in.data(), plan->MI, plan->NI, plan->f.data(), plan->MF, plan->NF, m0, m1, n);
+}
+
+// Interior row kernel picked at runtime, the unrolled one when the size has a Conv2DFixed specialization, else the
+// folded one for filters whose rows are mirrored (symmetry from FirDetectSymmetry(f, MF, NF))
+inline void Conv2DRowAny(float* out, const float* src, int ld, const float* f, int MF, int NF, int count, FirSymmetry symmetry = FirSymmetry::None) {
+	if (MF == NF) {
+		switch (MF) {
+			case 3: Conv2DRowFixed<3, 3>(out, src, ld, f, count); return;
+			case 5: Conv2DRowFixed<5, 5>(out, src, ld, f, count); return;
+			case 7: Conv2DRowFixed<7, 7>(out, src, ld, f, count); return;
+		}
+	}
+	if (symmetry != FirSymmetry::None) {
+		Conv2DRowSym(out, src, ld, f, MF, NF, FirSign(symmetry), count);
+		return;
+	}
+	Conv2DRow(out, src, ld, f, MF, NF, count);
+}
+
+// Full-output row segment dst[m0 .. m1) of row n, split into border and interior like Conv2DTile
+inline void Conv2DRowSegment(float* dst, const float* in, int MI, int NI, const float* f, int MF, int NF, int m0, int m1, int n, FirSymmetry symmetry = FirSymmetry::None) {
+	int a = m0 > MF - 1 ? m0 : MF - 1;
+	int b = m1 < MI ? m1 : MI;
+	if (n < NF - 1 || n >= NI || a >= b) {
+		Conv2DBorderRow(dst, in, MI, NI, f, MF, NF, m0, m1, n);
+		return;
+	}
+	Conv2DBorderRow(dst, in, MI, NI, f, MF, NF, m0, a, n);
+	Conv2DRowAny(dst + a, &in[n * MI + a], MI, f, MF, NF, b - a, symmetry);
+	Conv2DBorderRow(dst, in, MI, NI, f, MF, NF, b, m1, n);
+}
+
+// Interior row kernel for Conv2DTile, sized at compile time for the Conv2DFixed specializations (0 x 0 is generic,
+// folded when the filter rows are mirrored)
+template<int MF, int NF>
+struct Conv2DInterior {
+	static inline void Row(float* out, const float* src, int ld, const float* f, int, int, FirSymmetry, int count) {
+		Conv2DRowFixed<MF, NF>(out, src, ld, f, count);
+	}
+};
+template<>
+struct Conv2DInterior<0, 0> {
+	static inline void Row(float* out, const float* src, int ld, const float* f, int MF, int NF, FirSymmetry symmetry, int count) {
+		if (symmetry != FirSymmetry::None) {
+			Conv2DRowSym(out, src, ld, f, MF, NF, FirSign(symmetry), count);
+			return;
+		}
+		Conv2DRow(out, src, ld, f, MF, NF, count);
+	}
+};
+
+// Tile routine for Multithreading in Opimization 2 (compare loop with O1Convolve2D)
+// Interior rows go through the SIMD row kernel, everything else through Conv2DBorder
+// The tile is given in output window coordinates
+template<int MF, int NF, typename T1, typename T2>
+void Conv2DTile(Conv2DPlan<T1, T2>* plan, int m0, int m1, int n0, int n1) {
+	m0 += plan->M0; m1 += plan->M0;
+	n0 += plan->N0; n1 += plan->N0;
+	int a = m0 > plan->IM0 ? m0 : plan->IM0;
+	int b = m1 < plan->IM1 ? m1 : plan->IM1;
+	for (int n = n0; n < n1; ++n) {
+		if (n < plan->IN0 || n >= plan->IN1 || a >= b) {
+			Conv2DBorder(plan, m0, m1, n);
+			continue;
+		}
+		Conv2DBorder(plan, m0, a, n);
+		Conv2DInterior<MF, NF>::Row(plan->OutRow(n) + a, &plan->in[n * plan->MI + a], plan->MI, plan->f.data(), plan->MF, plan->NF, plan->symmetry, b - a);
+		Conv2DBorder(plan, b, m1, n);
+	}
+}
+
+// Output tile size handed to each pool task
+#define CONV_TILE_M 128
+#define CONV_TILE_N 32
 
-	std::thread* pool[CONV_POOL_SIZE];
-	int dn = plan.N / 10 + 1;
+// Direct convolution with a compile-time filter size (3x3, 5x5 and 7x7 are instantiated in simd.cpp)
+template<int MF, int NF, typename T1, typename T2>
+void Conv2DFixed(Conv2DPlan<T1, T2>* plan, ThreadPool& pool) {
+	pool.Tiles(plan->MO, plan->NO, CONV_TILE_M, CONV_TILE_N, [plan](int m0, int m1, int n0, int n1) -> void {
+		Conv2DTile<MF, NF>(plan, m0, m1, n0, n1);
+	});
+}
 
-	for (int i = 0; i < CONV_POOL_SIZE; ++i) {
-		int n0 = i * dn;
-		int n1 = n0 + dn;
-		pool[i] = new std::thread(Conv2DThread<T1, T2>, &plan, n0, n1);
+template<int MF, int NF, typename T1, typename T2>
+Image<float>* Conv2DFixed(Image<T1>* image, Image<T2>* filter, ConvMode mode = ConvMode::Full, ThreadPool& pool = ThreadPool::Shared()) {
+	if (filter->M() != MF || filter->N() != NF) { return nullptr; }
+	Conv2DPlan<T1, T2> plan(image, filter, mode);
+	Conv2DFixed<MF, NF>(&plan, pool);
+	return plan.out;
+}
+
+template<typename T1, typename T2>
+Image<float>* Conv2D(Image<T1>* image, Image<T2>* filter, ConvMode mode = ConvMode::Full, double rankError = 0, ThreadPool& pool = ThreadPool::Shared()) {
+	Conv2DPlan<T1, T2> plan(image, filter, mode, rankError);
+
+	if (plan.method == Conv2DMethod::Fixed) {
+		switch (plan.MF) {
+			case 3: Conv2DFixed<3, 3>(&plan, pool); break;
+			case 5: Conv2DFixed<5, 5>(&plan, pool); break;
+			case 7: Conv2DFixed<7, 7>(&plan, pool); break;
+		}
+		return plan.out;
 	}
 
-	for (int i = 0; i < CONV_POOL_SIZE; ++i) {
-		pool[i]->join();
-		delete pool[i];
-		pool[i] = nullptr;
+	if (plan.method == Conv2DMethod::FFT) {
+		Conv2DFFT(&plan, pool);
+		return plan.out;
+	}
+	if (plan.method == Conv2DMethod::Separable) {
+		Conv2DSeparable(&plan, pool);
+		return plan.out;
 	}
 
+	pool.Tiles(plan.MO, plan.NO, CONV_TILE_M, CONV_TILE_N, [&plan](int m0, int m1, int n0, int n1) -> void {
+		Conv2DTile<0, 0>(&plan, m0, m1, n0, n1);
+	});
+
 	return plan.out;
 }
 
-// Don't clutter up the pre-processor defintions, we're done with it
-#undef CONV_POOL_SIZE
+// Epilogues for Conv2DFused, each folds the K filter responses at a pixel into the output byte
+// Bytes are truncated like the (byte) casts in PA1
+inline byte ConvSaturate(float v) {
+	if (v > 255) { v = 255; }
+	if (v < 0) { v = 0; }
+	return (byte)v;
+}
 
+// Same window of image * filter scaled so its peak is 255, negatives clamped to 0 (PA1 Problem 4 and the batch
+// Filter step). The peak is the window's, so no full-size intermediate is computed.
 template<typename T1, typename T2>
-Image<float>* Conv(Signal<T1>* signal, Signal<T2>* filter) {
-	int NI = S->N();
-	int NF = F->N();
-	int N = NI + NF - 1;
-	Signal<float>* out = new Signal<float>(N);
+Image<byte>* Conv2DPeakScaled(Image<T1>* image, Image<T2>* filter, ThreadPool& pool = ThreadPool::Shared()) {
+	Image<float>* F = Conv2D(image, filter, ConvMode::Same, 0, pool);
+	float peak = F->Max(pool);
+	Image<byte>* out = new Image<byte>(F->M(), F->N());
+	if (peak > 0) {
+		out->zip_map(*F, [peak](byte, float v) -> byte {
+			return ConvSaturate(v * 255 / peak);
+		}, pool);
+	}
+	delete F;
+	return out;
+}
+
+// |g1| + ... + |gK|, clamped to 255 (Sobel magnitude)
+struct ConvAbsSum {
+	template<int K>
+	inline byte operator()(const float (&v)[K]) const {
+		float sum = 0;
+		for (int i = 0; i < K; ++i) { sum += v[i] < 0 ? -v[i] : v[i]; }
+		return ConvSaturate(sum);
+	}
+};
 
-	for (int n = 0; n < N; ++n) {
+// g1 + ... + gK, clamped to [0, 255]
+struct ConvClamp {
+	template<int K>
+	inline byte operator()(const float (&v)[K]) const {
 		float sum = 0;
-		for (int k = 0; k <= n && k < NF; ++k) {
-			sum += (float)filter->Get(k) * signal->Get(n - k);
+		for (int i = 0; i < K; ++i) { sum += v[i]; }
+		return ConvSaturate(sum);
+	}
+};
+
+// (g1 + ... + gK) * scale + offset, clamped to [0, 255]
+struct ConvScale {
+	float scale, offset;
+	ConvScale(float s, float o = 0) : scale(s), offset(o) {}
+
+	template<int K>
+	inline byte operator()(const float (&v)[K]) const {
+		float sum = 0;
+		for (int i = 0; i < K; ++i) { sum += v[i]; }
+		return ConvSaturate(sum * scale + offset);
+	}
+};
+
+// Convolve the image with K filters and fold the responses through epilogue in one sweep
+// epilogue is any byte(const float (&)[K]) functor (see ConvAbsSum), it's inlined into the tile loop
+// Each tile row is filtered by every kernel while the input rows are still in cache and only the byte
+// image is written, no float outputs are materialized. Returns nullptr if the filters' windows differ.
+template<int K, typename Epilogue, typename T1, typename T2>
+Image<byte>* Conv2DFused(Image<T1>* image, Image<T2>* const (&filters)[K], Epilogue epilogue, ConvMode mode = ConvMode::Same, ThreadPool& pool = ThreadPool::Shared()) {
+	int MI = image->M();
+	int NI = image->N();
+	int MO = 0, NO = 0;
+	int MF[K], NF[K], M0[K], N0[K];
+	for (int i = 0; i < K; ++i) {
+		MF[i] = filters[i]->M();
+		NF[i] = filters[i]->N();
+		int mo = 0, no = 0;
+		ConvWindow(mode, MI, MF[i], mo, M0[i]);
+		ConvWindow(mode, NI, NF[i], no, N0[i]);
+		if (i > 0 && (mo != MO || no != NO)) { return nullptr; }
+		MO = mo;
+		NO = no;
+	}
+
+	ArenaBuffer<float> in;
+	ArenaBuffer<float> f[K];
+	FirSymmetry symmetry[K];
+	Conv2DFloat(image, in);
+	for (int i = 0; i < K; ++i) {
+		Conv2DFloat(filters[i], f[i]);
+		symmetry[i] = FirDetectSymmetry(f[i].data(), MF[i], NF[i]);
+	}
+
+	Image<byte>* out = new Image<byte>(MO, NO);
+	pool.Tiles(MO, NO, CONV_TILE_M, CONV_TILE_N, [&](int m0, int m1, int n0, int n1) -> void {
+		float rows[K][CONV_TILE_M];
+		float v[K];
+		for (int n = n0; n < n1; ++n) {
+			// Row segments are addressed in each filter's full-output coordinates
+			for (int i = 0; i < K; ++i) {
+				Conv2DRowSegment(rows[i] - m0 - M0[i], in.data(), MI, NI, f[i].data(), MF[i], NF[i], m0 + M0[i], m1 + M0[i], n + N0[i], symmetry[i]);
+			}
+			byte* dst = out->Row(n);
+			for (int m = m0; m < m1; ++m) {
+				for (int i = 0; i < K; ++i) { v[i] = rows[i][m - m0]; }
+				dst[m] = epilogue(v);
+			}
+		}
+	});
+	return out;
+}
+
+// Output rows per strip of Conv2DStream (raised to the filter height)
+#define CONV_STREAM_ROWS 32
+
+// Convolve the 8-bit PGM at input with filter and write the output window, folded to bytes through epilogue (a
+// byte(const float (&)[1]) functor, see ConvClamp), to the PGM at output without holding either image in memory
+// Output rows are computed in strips of B rows over a rolling window of the input, the NF - 1 rows the next strip
+// still needs are moved to the front and the next B rows read in behind them. The next strip's rows are read and
+// the finished strip is written on other threads while the current one is computed, so memory stays at about
+// NF + 2B input rows and 2B output rows however tall the image is. Returns an ERROR_PGM code.
+template<typename T, typename Epilogue>
+int Conv2DStream(std::string input, std::string output, Image<T>* filter, Epilogue epilogue, ConvMode mode = ConvMode::Full, ThreadPool& pool = ThreadPool::Shared()) {
+	PGMReader reader;
+	int err = reader.open(input);
+	if (err != ERROR_NONE) { return err; }
+
+	int MI = reader.M(), NI = reader.N();
+	int MF = filter->M(), NF = filter->N();
+	int MO = 0, NO = 0, M0 = 0, N0 = 0;
+	ConvWindow(mode, MI, MF, MO, M0);
+	ConvWindow(mode, NI, NF, NO, N0);
+
+	PGMWriter writer;
+	err = writer.open(output, MO, NO);
+	if (err != ERROR_NONE) { return err; }
+
+	ArenaBuffer<float> f;
+	Conv2DFloat(filter, f);
+	FirSymmetry symmetry = FirDetectSymmetry(f.data(), MF, NF);
+
+	int B = CONV_STREAM_ROWS > NF ? CONV_STREAM_ROWS : NF;
+	int rows = NF - 1 + B;
+	ArenaBuffer<float> window((size_t)rows * MI); // input rows [lo, hi), row r at (r - lo) * MI
+	ArenaBuffer<byte> staging((size_t)rows * MI);
+	ArenaBuffer<float> sums((size_t)B * MO);
+	ArenaBuffer<byte> strips[2] = { ArenaBuffer<byte>((size_t)B * MO), ArenaBuffer<byte>((size_t)B * MO) };
+	int lo = 0, hi = 0, pending = 0;
+
+	// Staged rows go in behind the window's
+	auto append = [&](int count) -> void {
+		float* dst = &window[(size_t)(hi - lo) * MI];
+		for (size_t i = 0; i < (size_t)count * MI; ++i) { dst[i] = staging[i]; }
+		hi += count;
+	};
+	auto fetch = [&](int count) -> std::future<int> {
+		pending = count;
+		return std::async(std::launch::async, [&reader, &staging, count]() -> int {
+			return reader.read(staging.data(), count);
+		});
+	};
+
+	// The first strip needs the rows up to N0 + B, later ones B more each
+	int first = N0 + B < NI ? N0 + B : NI;
+	err = reader.read(staging.data(), first);
+	if (err != ERROR_NONE) { return err; }
+	append(first);
+
+	std::future<int> reading, writing;
+	if (hi < NI) { reading = fetch(B < NI - hi ? B : NI - hi); }
+
+	for (int s = N0, j = 0; s < N0 + NO; s += B, ++j) {
+		int count = N0 + NO - s < B ? N0 + NO - s : B;
+		byte* strip = strips[j & 1].data();
+
+		// Full-output row n is row n - lo of the window, which has every row it reads
+		pool.Rows(count, [&](int r0, int r1) -> void {
+			for (int r = r0; r < r1; ++r) {
+				float* dst = &sums[(size_t)r * MO] - M0;
+				Conv2DRowSegment(dst, window.data(), MI, NI - lo, f.data(), MF, NF, M0, M0 + MO, s + r - lo, symmetry);
+				for (int m = 0; m < MO; ++m) {
+					const float v[1] = { dst[M0 + m] };
+					strip[(size_t)r * MO + m] = epilogue(v);
+				}
+			}
+		});
+
+		// Strips go out in order, the previous one has to be written before this one starts
+		if (writing.valid() && (err = writing.get()) != ERROR_NONE) { return err; }
+		writing = std::async(std::launch::async, [&writer, strip, count]() -> int {
+			return writer.write(strip, count);
+		});
+
+		// Keep the rows the next strip still needs and take in the ones read meanwhile
+		int keep = hi - lo < NF - 1 ? hi - lo : NF - 1;
+		memmove(window.data(), &window[(size_t)(hi - keep - lo) * MI], sizeof(float) * keep * MI);
+		lo = hi - keep;
+		if (reading.valid()) {
+			if ((err = reading.get()) != ERROR_NONE) { return err; }
+			append(pending);
+			if (hi < NI) { reading = fetch(B < NI - hi ? B : NI - hi); }
+		}
+	}
+
+	if (writing.valid() && (err = writing.get()) != ERROR_NONE) { return err; }
+	return writer.close();
+}
+
+// Default for Conv2DInt, largest coefficient error relative to the largest coefficient
+#define CONV_QUANT_ERROR 1e-3
+
+// Filter quantized to int16 with one power of two scale, f ~= c / 2^shift, for Conv2DInt
+// shift is as large as int16 coefficients and int32 sums over 8-bit pixels allow
+class Conv2DQuant {
+public:
+	int MF, NF, shift;
+	int bias; // added before the shift so sums the rounding of c left just short of an integer don't truncate down
+	ArenaBuffer<short> c;     // MF x NF row-major
+	ArenaBuffer<int> offsets; // per tap, -(k * ld + l)
+	ArenaBuffer<int> pairs;   // tap pairs packed for Conv2DRowInt
+	double error;
+
+	template<typename T2>
+	Conv2DQuant(Image<T2>* filter, int ld) {
+		MF = filter->M();
+		NF = filter->N();
+		ArenaBuffer<float> f;
+		Conv2DFloat(filter, f);
+
+		double maxAbs = 0, sumAbs = 0;
+		for (float v : f) {
+			maxAbs = fabs(v) > maxAbs ? fabs(v) : maxAbs;
+			sumAbs += fabs(v);
+		}
+		shift = 0;
+		while (shift < 30 && maxAbs * (2 << shift) <= 32767 && sumAbs * 255 * (2 << shift) < 2147483647.0 - (2 << shift)) { ++shift; }
+
+		double scale = (double)(1 << shift);
+		int taps = MF * NF + (MF * NF) % 2;
+		c = ArenaBuffer<short>(taps);
+		offsets = ArenaBuffer<int>(taps);
+		pairs = ArenaBuffer<int>(taps / 2);
+		error = 0;
+		double under = 0;
+		for (int t = 0; t < MF * NF; ++t) {
+			double q = floor(f[t] * scale + 0.5);
+			q = q > 32767 ? 32767 : q < -32768 ? -32768 : q;
+			c[t] = (short)q;
+			error = fabs(q / scale - f[t]) > error ? fabs(q / scale - f[t]) : error;
+			offsets[t] = -((t / MF) * ld + t % MF);
+			under += f[t] * scale > q ? f[t] * scale - q : 0;
+		}
+		error = maxAbs > 0 ? error / maxAbs : 0;
+		bias = (int)ceil(under * 255);
+		for (int j = 0; j < taps / 2; ++j) {
+			pairs[j] = (int)(((unsigned)(unsigned short)c[2 * j + 1] << 16) | (unsigned short)c[2 * j]);
 		}
-		plan->out->Set(n, sum);
 	}
+};
+
+// Border outputs of the integer path, same zero padding as Conv2DBorderRow
+// in has rows ld bytes apart
+inline void Conv2DBorderRowInt(byte* dst, const byte* in, int ld, int MI, int NI, const Conv2DQuant& q, int m0, int m1, int n) {
+	int MF = q.MF, NF = q.NF;
+	int k0 = n - NI + 1 > 0 ? n - NI + 1 : 0;
+	int k1 = n < NF - 1 ? n : NF - 1;
+	for (int m = m0; m < m1; ++m) {
+		int l0 = m - MI + 1 > 0 ? m - MI + 1 : 0;
+		int l1 = m < MF - 1 ? m : MF - 1;
+		int sum = q.bias;
+		for (int k = k0; k <= k1; ++k) {
+			const byte* src = &in[(size_t)(n - k) * ld + m];
+			const short* ck = &q.c[k * MF];
+			for (int l = l0; l <= l1; ++l) {
+				sum += ck[l] * src[-l];
+			}
+		}
+		sum >>= q.shift;
+		dst[m] = (byte)(sum < 0 ? 0 : sum > 255 ? 255 : sum);
+	}
+}
+
+// Fixed point convolution of an 8-bit image straight to a saturated 8-bit output
+// The filter is quantized to int16 (see Conv2DQuant) and the sums are exact in int32, so the result is the
+// float path's clamped and truncated output up to the quantization. No float copies are made, the pixels are
+// read from the image directly. Returns nullptr if the filter doesn't quantize within tolerance.
+template<typename T2>
+Image<byte>* Conv2DInt(Image<byte>* image, Image<T2>* filter, ConvMode mode = ConvMode::Full, double tolerance = CONV_QUANT_ERROR, ThreadPool& pool = ThreadPool::Shared()) {
+	int MI = image->M();
+	int NI = image->N();
+	int ld = image->Stride();
+	Conv2DQuant q(filter, ld);
+	if (q.error > tolerance) { return nullptr; }
+
+	int MO, NO, M0, N0;
+	ConvWindow(mode, MI, q.MF, MO, M0);
+	ConvWindow(mode, NI, q.NF, NO, N0);
+	Image<byte>* out = new Image<byte>(MO, NO);
+	const byte* in = image->Row(0);
+
+	pool.Tiles(MO, NO, CONV_TILE_M, CONV_TILE_N, [&](int m0, int m1, int n0, int n1) -> void {
+		m0 += M0; m1 += M0;
+		int a = m0 > q.MF - 1 ? m0 : q.MF - 1;
+		int b = m1 < MI ? m1 : MI;
+		for (int n = n0 + N0; n < n1 + N0; ++n) {
+			byte* dst = out->Row(n - N0) - M0;
+			if (n < q.NF - 1 || n >= NI || a >= b) {
+				Conv2DBorderRowInt(dst, in, ld, MI, NI, q, m0, m1, n);
+				continue;
+			}
+			Conv2DBorderRowInt(dst, in, ld, MI, NI, q, m0, a, n);
+			Conv2DRowInt(dst + a, &in[(size_t)n * ld + a], q.offsets.data(), q.pairs.data(), (int)q.c.size(), q.bias, q.shift, b - a);
+			Conv2DBorderRowInt(dst, in, ld, MI, NI, q, b, m1, n);
+		}
+	});
+	return out;
+}
+
+// Don't clutter up the pre-processor defintions, we're done with it
+#undef CONV_TILE_M
+#undef CONV_TILE_N
+
+// 1D convolution through a FirFilter (direct or overlap-save, whichever is cheaper for the filter length)
+template<typename T1, typename T2>
+Signal<float>* Conv(Signal<T1>* signal, Signal<T2>* filter, ConvMode mode = ConvMode::Full) {
+	int NI = signal->N();
+	int NF = filter->N();
+	int NO = 0, N0 = 0;
+	ConvWindow(mode, NI, NF, NO, N0);
+	if (NI == 0 || NF == 0 || NO <= 0) { return new Signal<float>(NO > 0 ? NO : 0); }
+
+	std::vector<float> x(NI), h(NF), full(NI + NF - 1);
+	for (int n = 0; n < NI; ++n) { x[n] = (float)signal->Get(n); }
+	for (int k = 0; k < NF; ++k) { h[k] = (float)filter->Get(k); }
+
+	FirFilter fir(h.data(), NF);
+	fir.process(x.data(), NI, full.data());
+	fir.flush(full.data() + NI);
 
+	Signal<float>* out = new Signal<float>(NO);
+	for (int n = 0; n < NO; ++n) { out->Set(n, full[N0 + n]); }
 	return out;
 }
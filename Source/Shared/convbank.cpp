@@ -0,0 +1,106 @@
+#include "convbank.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Output tile size handed to each pool task on the direct path
+#define BANK_TILE_M 128
+#define BANK_TILE_N 32
+
+std::shared_ptr<const std::vector<cpx>> Conv2DBank::spectrum(Kernel& kernel, const FFT2D& fft, ThreadPool& pool) {
+	std::pair<int, int> key(fft.Width(), fft.Height());
+	{
+		std::lock_guard<std::mutex> guard(cacheLock);
+		auto it = kernel.spectra.find(key);
+		if (it != kernel.spectra.end()) { return it->second; }
+	}
+
+	// Transform with the lock released, the pool's waiting threads run other tasks (possibly another Apply() on
+	// this bank) and concurrent Apply() calls shouldn't queue up behind one kernel. Two threads may both transform
+	// a missing kernel, the first one in keeps its entry.
+	std::shared_ptr<std::vector<cpx>> spec = std::make_shared<std::vector<cpx>>(fft.SpecLength());
+	FFT2DForward(fft, kernel.f.data(), kernel.MF, kernel.NF, kernel.MF, spec->data(), pool);
+
+	std::lock_guard<std::mutex> guard(cacheLock);
+	return kernel.spectra.insert(std::make_pair(key, std::shared_ptr<const std::vector<cpx>>(spec))).first->second;
+}
+
+void Conv2DBank::apply(const ArenaBuffer<float>& in, int MI, int NI, ConvMode mode, ThreadPool& pool, std::vector<Image<float>*>& out) {
+	int K = Size();
+	std::vector<int> MO(K), NO(K), M0(K), N0(K);
+	out.resize(K);
+
+	// One transform size for the whole bank, large enough to keep wrap-around out of every window
+	int P = 1, Q = 1;
+	for (int i = 0; i < K; ++i) {
+		const Kernel& k = kernels[i];
+		ConvWindow(mode, MI, k.MF, MO[i], M0[i]);
+		ConvWindow(mode, NI, k.NF, NO[i], N0[i]);
+		P = std::max(P, std::max(M0[i] + MO[i], MI + k.MF - 1 - M0[i]));
+		Q = std::max(Q, std::max(N0[i] + NO[i], NI + k.NF - 1 - N0[i]));
+		out[i] = new Image<float>(MO[i], NO[i]);
+	}
+	P = FFT::FastSize(P);
+	Q = FFT::FastSize(Q);
+
+	// Same cost units as Conv2DPlan. With the spectra cached, a kernel only adds a pointwise product and an
+	// inverse transform to the frequency path, so it goes there when its direct cost is higher than that.
+	double PQ = (double)P * Q;
+	double transform = Conv2DTransformCost(PQ);
+	std::vector<int> direct, freq;
+	double freqDirect = 0;
+	for (int i = 0; i < K; ++i) {
+		const Kernel& k = kernels[i];
+		double cost = Conv2DDirectCost((double)MO[i] * NO[i] * k.MF * k.NF, k.MF, k.NF, k.symmetry);
+		if (cost > transform + PQ) {
+			freq.push_back(i);
+			freqDirect += cost;
+		} else {
+			direct.push_back(i);
+		}
+	}
+	// The image transform is paid once, skip it if those kernels don't save more than it costs
+	if (!freq.empty() && freqDirect < transform + freq.size() * (transform + PQ)) {
+		direct.insert(direct.end(), freq.begin(), freq.end());
+		freq.clear();
+	}
+
+	// Direct, every kernel runs over each tile row in turn so the input rows are loaded once per tile
+	int MT = 0, NT = 0;
+	for (int i : direct) {
+		MT = std::max(MT, MO[i]);
+		NT = std::max(NT, NO[i]);
+	}
+	pool.Tiles(MT, NT, BANK_TILE_M, BANK_TILE_N, [&](int m0, int m1, int n0, int n1) -> void {
+		for (int n = n0; n < n1; ++n) {
+			for (int i : direct) {
+				if (n >= NO[i] || m0 >= MO[i]) { continue; }
+				const Kernel& k = kernels[i];
+				int e = m1 < MO[i] ? m1 : MO[i];
+				Conv2DRowSegment(out[i]->Row(n) - M0[i], in.data(), MI, NI, k.f.data(), k.MF, k.NF, m0 + M0[i], e + M0[i], n + N0[i], k.symmetry);
+			}
+		}
+	});
+
+	// Frequency domain, one forward transform of the image shared by every kernel
+	if (freq.empty()) { return; }
+	FFT2D fft(P, Q);
+	ArenaBuffer<cpx> SI(fft.SpecLength());
+	ArenaBuffer<cpx> S(fft.SpecLength());
+	FFT2DForward(fft, in.data(), MI, NI, MI, SI.data(), pool);
+	for (int i : freq) {
+		std::shared_ptr<const std::vector<cpx>> spec = spectrum(kernels[i], fft, pool);
+		const std::vector<cpx>& SF = *spec;
+		pool.Rows(fft.Height(), [&](int q0, int q1) -> void {
+			for (int j = q0 * fft.SpecWidth(); j < q1 * fft.SpecWidth(); ++j) {
+				S[j] = SI[j] * SF[j];
+			}
+		});
+		if (MO[i] == 0 || NO[i] == 0) { continue; }
+		FFT2DInverse(fft, S.data(), out[i]->Row(0), M0[i], N0[i], MO[i], NO[i], out[i]->Stride(), pool);
+	}
+}
+
+void Conv2DBank::Clear() {
+	std::lock_guard<std::mutex> guard(cacheLock);
+	for (Kernel& k : kernels) { k.spectra.clear(); }
+}
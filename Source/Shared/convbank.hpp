@@ -0,0 +1,56 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "conv.hpp"
+
+// Set of kernels convolved with the same image (matched templates, oriented edge filters, ...)
+// The image is converted and transformed (or tiled) once and shared by every kernel, and kernel spectra
+// are cached per transform size so repeated images of one size only pay for the image transform
+class Conv2DBank {
+private:
+	struct Kernel {
+		int MF, NF;
+		std::vector<float> f;
+		FirSymmetry symmetry;
+		std::map<std::pair<int, int>, std::shared_ptr<const std::vector<cpx>>> spectra; // by transform size (P, Q)
+	};
+	std::vector<Kernel> kernels;
+	std::mutex cacheLock;
+
+	// Shared so a Clear() during Apply() only drops the cache entry, not the spectrum being read
+	std::shared_ptr<const std::vector<cpx>> spectrum(Kernel& kernel, const FFT2D& fft, ThreadPool& pool);
+	void apply(const ArenaBuffer<float>& in, int MI, int NI, ConvMode mode, ThreadPool& pool, std::vector<Image<float>*>& out);
+
+public:
+	template<typename T>
+	Conv2DBank(const std::vector<Image<T>*>& filters) {
+		kernels.resize(filters.size());
+		for (size_t i = 0; i < filters.size(); ++i) {
+			kernels[i].MF = filters[i]->M();
+			kernels[i].NF = filters[i]->N();
+			Conv2DFloat(filters[i], kernels[i].f);
+			kernels[i].symmetry = FirDetectSymmetry(kernels[i].f.data(), kernels[i].MF, kernels[i].NF);
+		}
+	}
+
+	Conv2DBank(const Conv2DBank& rhs) = delete;
+	Conv2DBank& operator=(Conv2DBank const& rhs) = delete;
+
+	inline int Size() const { return (int)kernels.size(); }
+
+	// One output per kernel, in order, each the same as Conv2D(image, filter, mode) up to float round off
+	template<typename T>
+	std::vector<Image<float>*> Apply(Image<T>* image, ConvMode mode = ConvMode::Full, ThreadPool& pool = ThreadPool::Shared()) {
+		ArenaBuffer<float> in;
+		Conv2DFloat(image, in);
+		std::vector<Image<float>*> out;
+		apply(in, image->M(), image->N(), mode, pool, out);
+		return out;
+	}
+
+	// Drop the cached kernel spectra, safe to call while Apply() runs
+	void Clear();
+};
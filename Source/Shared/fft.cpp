@@ -0,0 +1,256 @@
+#include "fft.hpp"
+#include <cmath>
+
+static const double PI = 3.14159265358979323846;
+
+FFT::FFT(int length) {
+	n = length;
+
+	// Factor n, preferring radix 4 then 2, 3, 5 (anything left over goes to the generic butterfly)
+	int r = n;
+	int p = 4;
+	while (r > 1) {
+		while (r % p != 0) {
+			switch (p) {
+				case 4: p = 2; break;
+				case 2: p = 3; break;
+				default: p += 2; break;
+			}
+			if (p * p > r) { p = r; }
+		}
+		r /= p;
+		factors.push_back(p);
+		factors.push_back(r);
+	}
+	if (n == 1) {
+		factors.push_back(1);
+		factors.push_back(1);
+	}
+
+	twiddles[0].resize(n);
+	twiddles[1].resize(n);
+	for (int i = 0; i < n; ++i) {
+		double phase = -2 * PI * i / n;
+		twiddles[0][i] = cpx((float)cos(phase), (float)sin(phase));
+		twiddles[1][i] = std::conj(twiddles[0][i]);
+	}
+}
+
+int FFT::FastSize(int n) {
+	if (n <= 1) { return 1; }
+	while (true) {
+		int m = n;
+		while (m % 2 == 0) { m /= 2; }
+		while (m % 3 == 0) { m /= 3; }
+		while (m % 5 == 0) { m /= 5; }
+		if (m == 1) { return n; }
+		++n;
+	}
+}
+
+void FFT::Forward(const cpx* in, cpx* out, int istride) const {
+	work(out, in, 1, istride, factors.data(), twiddles[0].data());
+}
+
+void FFT::Inverse(const cpx* in, cpx* out, int istride) const {
+	work(out, in, 1, istride, factors.data(), twiddles[1].data());
+}
+
+void FFT::work(cpx* out, const cpx* in, int fstride, int istride, const int* f, const cpx* tw) const {
+	int p = f[0];
+	int m = f[1];
+
+	if (m == 1) {
+		for (int j = 0; j < p; ++j) {
+			out[j] = in[j * fstride * istride];
+		}
+	}
+	else {
+		for (int j = 0; j < p; ++j) {
+			work(out + j * m, in + j * fstride * istride, fstride * p, istride, f + 2, tw);
+		}
+	}
+
+	switch (p) {
+		case 1: break;
+		case 2: butterfly2(out, fstride, m, tw); break;
+		case 4: butterfly4(out, fstride, m, tw, tw == twiddles[1].data()); break;
+		default: butterfly(out, fstride, m, p, tw); break;
+	}
+}
+
+void FFT::butterfly2(cpx* out, int fstride, int m, const cpx* tw) const {
+	cpx* out2 = out + m;
+	for (int u = 0; u < m; ++u) {
+		cpx t = out2[u] * tw[u * fstride];
+		out2[u] = out[u] - t;
+		out[u] += t;
+	}
+}
+
+void FFT::butterfly4(cpx* out, int fstride, int m, const cpx* tw, bool inverse) const {
+	for (int u = 0; u < m; ++u) {
+		cpx s0 = out[u + m] * tw[u * fstride];
+		cpx s1 = out[u + 2 * m] * tw[u * fstride * 2];
+		cpx s2 = out[u + 3 * m] * tw[u * fstride * 3];
+
+		cpx s5 = out[u] - s1;
+		out[u] += s1;
+		cpx s3 = s0 + s2;
+		cpx s4 = s0 - s2;
+
+		// Multiply s4 by -j (forward) or +j (inverse)
+		cpx s4j = inverse ? cpx(-s4.imag(), s4.real()) : cpx(s4.imag(), -s4.real());
+
+		out[u + 2 * m] = out[u] - s3;
+		out[u] += s3;
+		out[u + m] = s5 + s4j;
+		out[u + 3 * m] = s5 - s4j;
+	}
+}
+
+void FFT::butterfly(cpx* out, int fstride, int m, int p, const cpx* tw) const {
+	cpx scratch[16];
+	std::vector<cpx> heap;
+	cpx* s = scratch;
+	if (p > 16) {
+		heap.resize(p);
+		s = heap.data();
+	}
+
+	for (int u = 0; u < m; ++u) {
+		int k = u;
+		for (int q = 0; q < p; ++q) {
+			s[q] = out[k];
+			k += m;
+		}
+
+		k = u;
+		for (int q1 = 0; q1 < p; ++q1) {
+			int twidx = 0;
+			out[k] = s[0];
+			for (int q = 1; q < p; ++q) {
+				twidx += fstride * k;
+				if (twidx >= n) { twidx -= n; }
+				out[k] += s[q] * tw[twidx];
+			}
+			k += m;
+		}
+	}
+}
+
+FFT2D::FFT2D(int p, int q) : rows(p), cols(q) {
+	P = p;
+	Q = q;
+	H = P / 2 + 1;
+}
+
+void FFT2D::Forward(const float* in, int w, int h, int ld, cpx* spec) const {
+	ForwardRows(in, w, h, ld, spec, 0, Q);
+	ForwardCols(spec, 0, H);
+}
+
+void FFT2D::Inverse(cpx* spec, float* out, int m0, int n0, int w, int h, int ld) const {
+	InverseCols(spec, 0, H);
+	InverseRows(spec, out, m0, n0, w, h, ld, 0, h);
+}
+
+void FFT2D::ForwardRows(const float* in, int w, int h, int ld, cpx* spec, int r0, int r1) const {
+	std::vector<cpx> z(P), Z(P);
+	if (w > P) { w = P; }
+
+	for (int r = r0; r < r1; r += 2) {
+		cpx* X = spec + r * H;
+		cpx* Y = spec + (r + 1) * H;
+		bool pair = r + 1 < r1;
+
+		// Rows past the end of the block are all zero
+		if (r >= h) {
+			for (int k = 0; k < H; ++k) { X[k] = 0; }
+			if (pair) {
+				for (int k = 0; k < H; ++k) { Y[k] = 0; }
+			}
+			continue;
+		}
+
+		// Pack two real rows into one complex transform
+		const float* a = in + r * ld;
+		const float* b = (pair && r + 1 < h) ? a + ld : nullptr;
+		for (int m = 0; m < w; ++m) {
+			z[m] = cpx(a[m], b ? b[m] : 0.0f);
+		}
+		for (int m = w; m < P; ++m) {
+			z[m] = 0;
+		}
+		rows.Forward(z.data(), Z.data());
+
+		// X[k] = (Z[k] + conj(Z[P-k])) / 2, Y[k] = (Z[k] - conj(Z[P-k])) / 2j
+		for (int k = 0; k < H; ++k) {
+			cpx zk = Z[k];
+			cpx zc = std::conj(Z[k == 0 ? 0 : P - k]);
+			X[k] = (zk + zc) * 0.5f;
+			if (pair) {
+				cpx d = (zk - zc) * 0.5f;
+				Y[k] = cpx(d.imag(), -d.real());
+			}
+		}
+	}
+}
+
+void FFT2D::ForwardCols(cpx* spec, int k0, int k1) const {
+	std::vector<cpx> col(Q);
+	for (int k = k0; k < k1; ++k) {
+		cols.Forward(spec + k, col.data(), H);
+		for (int q = 0; q < Q; ++q) {
+			spec[q * H + k] = col[q];
+		}
+	}
+}
+
+void FFT2D::InverseCols(cpx* spec, int k0, int k1) const {
+	std::vector<cpx> col(Q);
+	for (int k = k0; k < k1; ++k) {
+		cols.Inverse(spec + k, col.data(), H);
+		for (int q = 0; q < Q; ++q) {
+			spec[q * H + k] = col[q];
+		}
+	}
+}
+
+void FFT2D::InverseRows(const cpx* spec, float* out, int m0, int n0, int w, int h, int ld, int r0, int r1) const {
+	std::vector<cpx> Z(P), z(P);
+	float scale = 1.0f / ((float)P * Q);
+	int end = r1 < h ? r1 : h;
+
+	for (int r = r0; r < end; r += 2) {
+		const cpx* X = spec + (n0 + r) * H;
+		const cpx* Y = spec + (n0 + r + 1) * H;
+		bool pair = r + 1 < end;
+
+		// Rebuild the full Hermitian spectra of both rows as Z = X + jY
+		for (int k = 0; k < P; ++k) {
+			cpx x, y;
+			if (k < H) {
+				x = X[k];
+				y = pair ? Y[k] : 0;
+			}
+			else {
+				x = std::conj(X[P - k]);
+				y = pair ? std::conj(Y[P - k]) : 0;
+			}
+			Z[k] = cpx(x.real() - y.imag(), x.imag() + y.real());
+		}
+		rows.Inverse(Z.data(), z.data());
+
+		float* a = out + r * ld;
+		for (int m = 0; m < w; ++m) {
+			a[m] = z[m0 + m].real() * scale;
+		}
+		if (pair) {
+			float* b = a + ld;
+			for (int m = 0; m < w; ++m) {
+				b[m] = z[m0 + m].imag() * scale;
+			}
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <complex>
+#include <vector>
+
+typedef std::complex<float> cpx;
+
+// Mixed radix (2, 3, 4, 5) complex FFT of a fixed length, kiss-fft style recursive decomposition
+class FFT {
+private:
+	int n;
+	std::vector<int> factors;
+	std::vector<cpx> twiddles[2]; // [0] forward, [1] inverse
+
+	void work(cpx* out, const cpx* in, int fstride, int istride, const int* f, const cpx* tw) const;
+	void butterfly2(cpx* out, int fstride, int m, const cpx* tw) const;
+	void butterfly4(cpx* out, int fstride, int m, const cpx* tw, bool inverse) const;
+	void butterfly(cpx* out, int fstride, int m, int p, const cpx* tw) const;
+
+public:
+	FFT(int length);
+
+	inline int N() const { return n; }
+
+	// Out of place transforms; in is read with a stride of istride, out is contiguous
+	// Inverse is not scaled by 1/N
+	void Forward(const cpx* in, cpx* out, int istride = 1) const;
+	void Inverse(const cpx* in, cpx* out, int istride = 1) const;
+
+	// Smallest 2^a 3^b 5^c >= n
+	static int FastSize(int n);
+};
+
+// 2D real-to-complex transform over a P x Q zero padded grid
+// Only the P/2+1 non-redundant columns of the spectrum are kept, stored row-major (Q rows of H)
+class FFT2D {
+private:
+	int P, Q, H;
+	FFT rows, cols;
+
+public:
+	FFT2D(int p, int q);
+
+	inline int Width() const { return P; }
+	inline int Height() const { return Q; }
+	inline int SpecWidth() const { return H; }
+	inline int SpecLength() const { return Q * H; }
+
+	// Transform the w x h real block in (row stride ld) placed at the origin of the grid
+	void Forward(const float* in, int w, int h, int ld, cpx* spec) const;
+
+	// Inverse transform spec (destroyed) and write the w x h window at (m0, n0) to out (row stride ld)
+	// The result is scaled by 1/(PQ)
+	void Inverse(cpx* spec, float* out, int m0, int n0, int w, int h, int ld) const;
+
+	// Individual passes, Forward/Inverse run these over the full range (row ranges must start even, InverseRows clips r1 to h)
+	void ForwardRows(const float* in, int w, int h, int ld, cpx* spec, int r0, int r1) const;
+	void ForwardCols(cpx* spec, int k0, int k1) const;
+	void InverseCols(cpx* spec, int k0, int k1) const;
+	void InverseRows(const cpx* spec, float* out, int m0, int n0, int w, int h, int ld, int r0, int r1) const;
+};
@@ -0,0 +1,177 @@
+#include "fir.hpp"
+#include <cmath>
+#include <cstring>
+#include "simd.hpp"
+
+FirSymmetry FirDetectSymmetry(const float* h, int n, int rows) {
+	double peak = 0;
+	for (int i = 0; i < n * rows; ++i) { peak = fabs(h[i]) > peak ? fabs(h[i]) : peak; }
+	if (n < 2 || peak == 0) { return FirSymmetry::None; }
+
+	double tolerance = FIR_SYMMETRY_EXACT * peak;
+	bool even = true, odd = true;
+	for (int k = 0; k < rows; ++k) {
+		const float* r = h + k * n;
+		for (int i = 0; i <= (n - 1) / 2; ++i) {
+			even = even && fabs((double)r[i] - r[n - 1 - i]) <= tolerance;
+			odd = odd && fabs((double)r[i] + r[n - 1 - i]) <= tolerance;
+		}
+	}
+	return even ? FirSymmetry::Even : odd ? FirSymmetry::Odd : FirSymmetry::None;
+}
+
+float FirDotFolded(const float* h, const float* x, int n, FirSymmetry symmetry) {
+	float sum = 0;
+	int half = n / 2;
+	if (symmetry == FirSymmetry::Odd) {
+		for (int i = 0; i < half; ++i) { sum += h[i] * (x[i] - x[n - 1 - i]); }
+		return sum;
+	}
+	for (int i = 0; i < half; ++i) { sum += h[i] * (x[i] + x[n - 1 - i]); }
+	return (n & 1) ? sum + h[half] * x[half] : sum;
+}
+
+// Cost per output in MACs, the direct one is the taps (0.75 of them folded, as for Conv2DPlan), the overlap-save one
+// is a forward and an inverse complex transform (2.5 P log2 P each) and the spectrum product per two segments,
+// weighted by how much slower the scalar transforms run than the SIMD direct kernel (measured)
+#define FIR_FFT_WEIGHT 12.0
+
+static double FirDirectCost(int n, FirSymmetry symmetry) {
+	return symmetry != FirSymmetry::None ? 0.75 * n : n;
+}
+
+static double FirFFTCost(int n, int P) {
+	double L = P - n + 1;
+	return FIR_FFT_WEIGHT * (2 * 2.5 * P * log2((double)P) + 3.0 * P) / (2 * L);
+}
+
+int FirFilter::FFTSize(int n, FirSymmetry symmetry) {
+	// Candidates from 2 n up, longer transforms amortize the overlap better but cost more per sample
+	int best = 0;
+	double cost = FirDirectCost(n, symmetry);
+	for (int P = 2; P <= (1 << 24); P <<= 1) {
+		if (P < 2 * n) { continue; }
+		if (P > 64 * n && best != 0) { break; }
+		double c = FirFFTCost(n, P);
+		if (c < cost) {
+			cost = c;
+			best = P;
+		}
+	}
+	return best;
+}
+
+FirFilter::FirFilter(const float* taps, int n) {
+	init(taps, n, FFTSize(n, FirDetectSymmetry(taps, n)) > 0 ? FirMethod::FFT : FirMethod::Direct);
+}
+
+FirFilter::FirFilter(const float* taps, int n, FirMethod path) {
+	init(taps, n, path);
+}
+
+void FirFilter::init(const float* taps, int n, FirMethod path) {
+	NF = n > 0 ? n : 1;
+	h.assign(NF, 0.0f);
+	for (int k = 0; k < n; ++k) { h[k] = taps[k]; }
+	symmetry = FirDetectSymmetry(h.data(), NF);
+	method = path;
+	fft = nullptr;
+
+	if (method == FirMethod::Direct) {
+		L = FIR_DIRECT_BLOCK;
+		work.assign(NF - 1 + L, 0.0f);
+		return;
+	}
+
+	// Any transform of at least 2 NF works when the FFT path is forced
+	int P = FFTSize(NF, symmetry);
+	if (P == 0) {
+		P = 2;
+		while (P < 2 * NF) { P <<= 1; }
+	}
+	L = P - NF + 1;
+	work.assign(NF - 1 + 2 * L, 0.0f);
+	fft = new FFT(P);
+	H.assign(P, 0.0f);
+	z.assign(P, 0.0f);
+	Z.assign(P, 0.0f);
+	for (int k = 0; k < NF; ++k) { z[k] = h[k]; }
+	fft->Forward(z.data(), H.data());
+	// Fold the 1 / P of the unscaled inverse into the filter spectrum
+	for (int k = 0; k < P; ++k) { H[k] *= 1.0f / P; }
+}
+
+FirFilter::~FirFilter() {
+	delete fft;
+}
+
+void FirFilter::reset() {
+	std::fill(work.begin(), work.end(), 0.0f);
+}
+
+void FirFilter::process(const float* in, int n, float* out) {
+	if (method == FirMethod::Direct) {
+		direct(in, n, out);
+	}
+	else {
+		overlapSave(in, n, out);
+	}
+}
+
+void FirFilter::flush(float* out) {
+	// Zeros through the normal path
+	float zeros[256] = {};
+	int left = NF - 1;
+	while (left > 0) {
+		int count = left < 256 ? left : 256;
+		process(zeros, count, out);
+		out += count;
+		left -= count;
+	}
+	reset();
+}
+
+void FirFilter::direct(const float* in, int n, float* out) {
+	float* x = work.data() + NF - 1; // x[t] with x[t - NF + 1 .. t - 1] in front of it
+	while (n > 0) {
+		int count = n < L ? n : L;
+		memcpy(x, in, sizeof(float) * count);
+		if (symmetry != FirSymmetry::None) {
+			Conv2DRowSym(out, x, 0, h.data(), NF, 1, FirSign(symmetry), count);
+		}
+		else {
+			Conv2DRow(out, x, 0, h.data(), NF, 1, count);
+		}
+		memmove(work.data(), x + count - (NF - 1), sizeof(float) * (NF - 1));
+		in += count;
+		out += count;
+		n -= count;
+	}
+}
+
+void FirFilter::overlapSave(const float* in, int n, float* out) {
+	int P = fft->N();
+	float* x = work.data() + NF - 1;
+	while (n > 0) {
+		// Up to two segments, [history | first L] in the real part and the window L later in the imaginary part
+		int count = n < 2 * L ? n : 2 * L;
+		memcpy(x, in, sizeof(float) * count);
+		int valid = NF - 1 + count;
+		for (int t = 0; t < P; ++t) {
+			z[t] = cpx(t < valid ? work[t] : 0.0f, L + t < valid ? work[L + t] : 0.0f);
+		}
+		fft->Forward(z.data(), Z.data());
+		for (int k = 0; k < P; ++k) { Z[k] *= H[k]; }
+		fft->Inverse(Z.data(), z.data());
+
+		// Circular wrap only reaches the first NF - 1 outputs of each window
+		int first = count < L ? count : L;
+		for (int i = 0; i < first; ++i) { out[i] = z[NF - 1 + i].real(); }
+		for (int i = first; i < count; ++i) { out[i] = z[NF - 1 + i - L].imag(); }
+
+		memmove(work.data(), x + count - (NF - 1), sizeof(float) * (NF - 1));
+		in += count;
+		out += count;
+		n -= count;
+	}
+}
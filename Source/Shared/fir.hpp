@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include "fft.hpp"
+
+// Mirror symmetry of a linear phase FIR, h[i] = h[n - 1 - i] (Even) or h[i] = -h[n - 1 - i] (Odd)
+// Folded kernels add (or subtract) the mirrored samples first and multiply once per pair of taps
+enum class FirSymmetry {
+	None,
+	Even,
+	Odd,
+};
+
+// Difference, relative to the largest tap, under which mirrored taps count as equal (float round off of the design)
+#define FIR_SYMMETRY_EXACT 1e-6
+
+// Symmetry shared by every row of the rows x n row-major taps h (rows = 1 for a 1D filter), None if a row breaks it
+FirSymmetry FirDetectSymmetry(const float* h, int n, int rows = 1);
+
+// Sign the folded kernel takes (Conv2DRowSym)
+inline int FirSign(FirSymmetry symmetry) {
+	return symmetry == FirSymmetry::Odd ? -1 : 1;
+}
+
+// Dot product of a symmetric h (all n taps given) with x, mirrored samples added (or subtracted) first so each pair
+// of taps costs one multiply. That halves the multiplies of scalar code, with FMA SIMD a plain DotF32 over the
+// padded row is faster (the mirrored half has to be reversed in registers).
+float FirDotFolded(const float* h, const float* x, int n, FirSymmetry symmetry);
+
+enum class FirMethod {
+	Direct, // SIMD row kernel over the taps (folded when they are symmetric)
+	FFT,    // overlap-save
+};
+
+// Inputs per step of the direct path, bounds the history copy at (taps - 1) / FIR_DIRECT_BLOCK per sample
+#define FIR_DIRECT_BLOCK 4096
+
+// Streaming FIR, out[t] = sum_k h[k] x[t - k] over everything pushed so far, the inputs before the first call are 0
+// Short filters run direct through the Conv2D row kernels. Long ones go by overlap-save on power of two transforms
+// (two segments per complex transform, one in the real and one in the imaginary part, a real filter keeps them
+// apart). The path is picked at construction from the cost per output and every buffer is allocated there, so
+// process() never allocates and a signal of any length can be filtered a block at a time.
+class FirFilter {
+private:
+	int NF;
+	FirMethod method;
+	FirSymmetry symmetry;
+	std::vector<float> h;
+	int L;                   // new inputs per overlap-save segment (P - NF + 1), or per direct step
+	std::vector<float> work; // the last NF - 1 inputs followed by the current step's
+	FFT* fft;
+	std::vector<cpx> H, z, Z;
+
+	void init(const float* taps, int n, FirMethod path);
+	void direct(const float* in, int n, float* out);
+	void overlapSave(const float* in, int n, float* out);
+
+public:
+	FirFilter(const float* taps, int n);
+	FirFilter(const float* taps, int n, FirMethod path);
+	~FirFilter();
+
+	FirFilter(const FirFilter& rhs) = delete;
+	FirFilter& operator=(FirFilter const& rhs) = delete;
+
+	inline int Taps() const { return NF; }
+	inline FirMethod Method() const { return method; }
+	inline FirSymmetry Symmetry() const { return symmetry; }
+
+	// Overlap-save transform size for n taps, 0 when the direct path is cheaper
+	static int FFTSize(int n, FirSymmetry symmetry = FirSymmetry::None);
+
+	// Filter the next n inputs into out (n outputs)
+	void process(const float* in, int n, float* out);
+
+	// The Taps() - 1 outputs still owed after the last input (zeros pushed), leaves the filter reset
+	void flush(float* out);
+
+	// Forget the history
+	void reset();
+};
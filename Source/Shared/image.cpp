@@ -1,137 +1,248 @@
 #include "image.hpp"
-#include <fstream>
+#include <climits>
+#include <cstring>
+#include <vector>
+#include <cstdio>
+#include "mapped.hpp"
+
+static inline bool Whitespace(byte c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
 
-enum ParsePGM {
-	Width,
-	Height,
-	MaxVal,
-	Data,
-};
+// Next decimal field of the header, skipping whitespace and comments (# to the end of the line) in front of it
+static bool ParseField(const byte* p, size_t size, size_t& i, int& value) {
+	while (i < size) {
+		if (Whitespace(p[i])) { ++i; }
+		else if (p[i] == '#') {
+			while (i < size && p[i] != '\n') { ++i; }
+		}
+		else { break; }
+	}
+
+	long long v = 0;
+	size_t start = i;
+	while (i < size && p[i] >= '0' && p[i] <= '9') {
+		v = v * 10 + (p[i++] - '0');
+		if (v > INT_MAX) { return false; }
+	}
+	value = (int)v;
+	return i > start && i < size;
+}
+
+int ParsePGMHeader(const byte* p, size_t size, int& width, int& height, int& maxval, size_t& offset) {
+	size_t i = 2;
+	if (size < 3 || p[0] != 'P' || p[1] != '5' || !Whitespace(p[2])) { return ERROR_PGM_HEADER; }
+	if (!ParseField(p, size, i, width) || !ParseField(p, size, i, height) || !ParseField(p, size, i, maxval)) {
+		return ERROR_PGM_HEADER;
+	}
+	if (!Whitespace(p[i])) { return ERROR_PGM_HEADER; }
+	if (maxval < 1 || maxval > 65535) { return ERROR_PGM_HEADER | ERROR_PGM_MAXSIZE; }
+
+	offset = i + 1;
+	return ERROR_NONE;
+}
+
+// Header of a mapped file, with the checks for loading the whole image
+static int ParseHeader(const byte* p, size_t size, int& width, int& height, int& maxval, size_t& offset) {
+	int err = ParsePGMHeader(p, size, width, height, maxval, offset);
+	if (err != ERROR_NONE) { return err; }
+	if ((long long)width * height > INT_MAX) { return ERROR_PGM_SIZE; }
+	long long bytes = (long long)width * height * (maxval > 255 ? 2 : 1);
+	if ((long long)(size - offset) < bytes) { return ERROR_PGM_TRUNCATED; }
+	return ERROR_NONE;
+}
 
 int OpenPGM(std::string file, Image<byte>** out) {
-	std::fstream fin(file, std::ios::binary | std::ios::in);
-	if (!fin) {
+	MappedFile* map = MappedFile::Open(file);
+	if (map == nullptr) {
 		return ERROR_PGM_FILE;
 	}
 
-	char in;
-	bool error = false;
+	int width = 0, height = 0, maxval = 0;
+	size_t offset = 0;
+	int err = ParseHeader(map->Data(), map->Size(), width, height, maxval, offset);
+	if (err == ERROR_NONE && maxval > 255) { err = ERROR_PGM_HEADER | ERROR_PGM_MAXSIZE; }
+	if (err != ERROR_NONE) {
+		delete map;
+		return err;
+	}
 
-	// Validate the magic numbers
-	fin.read(&in, 1);
-	if (in == 'P') {
-		fin.read(&in, 1);
-		if (in == '5') {
-			fin.read(&in, 1);
-			if (in != '\n') {
-				error = true;
-			}
+	std::shared_ptr<MappedFile> keep(map);
+	*out = new Image<byte>(width, height, map->Data() + offset, keep);
+	return ERROR_NONE;
+}
+
+int OpenPGM(std::string file, Image<uint16_t>** out) {
+	MappedFile* map = MappedFile::Open(file);
+	if (map == nullptr) {
+		return ERROR_PGM_FILE;
+	}
+
+	int width = 0, height = 0, maxval = 0;
+	size_t offset = 0;
+	int err = ParseHeader(map->Data(), map->Size(), width, height, maxval, offset);
+	if (err != ERROR_NONE) {
+		delete map;
+		return err;
+	}
+
+	Image<uint16_t>* image = new Image<uint16_t>(width, height);
+	int depth = maxval > 255 ? 2 : 1;
+	for (int n = 0; n < height; ++n) {
+		const byte* src = map->Data() + offset + (size_t)width * depth * n;
+		uint16_t* dst = image->Row(n);
+		if (depth == 2) {
+			for (int m = 0; m < width; ++m) { dst[m] = (uint16_t)(src[2 * m] << 8 | src[2 * m + 1]); }
 		}
 		else {
-			error = true;
+			for (int m = 0; m < width; ++m) { dst[m] = src[m]; }
 		}
-	} else {
-		error = true;
 	}
+	delete map;
 
-	if (error) {
-		fin.close();
-		return ERROR_PGM_HEADER;
-	}
+	*out = image;
+	return ERROR_NONE;
+}
 
-	// Do the actual parsing
-	Image<byte>* iin = new Image<byte>();
+// Output is assembled in one buffer, header first, and goes out in a single checked fwrite. The fclose is checked
+// too, so a full disk or a failed flush comes back as ERROR_PGM_FILE.
+static byte* PGMBuffer(ArenaBuffer<byte>& buf, int width, int height, int maxval) {
+	char header[64];
+	int n = snprintf(header, sizeof(header), "P5\n%d %d %d\n", width, height, maxval);
+	buf.resize(n + (size_t)width * height * (maxval > 255 ? 2 : 1));
+	memcpy(buf.data(), header, n);
+	return buf.data() + n;
+}
 
-	ParsePGM state = ParsePGM::Width;
-	bool comment = false;
-	bool newline = true;
-	int maxsize = 0;
+static int WritePGM(std::string file, const ArenaBuffer<byte>& buf) {
+	std::FILE* f = fopen(file.c_str(), "wb");
+	if (f == nullptr) {
+		return ERROR_PGM_FILE;
+	}
+	bool ok = fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+	if (fclose(f) != 0) { ok = false; }
+	return ok ? ERROR_NONE : ERROR_PGM_FILE;
+}
 
-	while (true) {
-		fin.read(&in, 1);
+int SavePGM(std::string file, Image<byte>* out) {
+	ArenaBuffer<byte> buf;
+	byte* dst = PGMBuffer(buf, out->M(), out->N(), 255);
+	for (int n = 0; n < out->N(); ++n) {
+		memcpy(dst + (size_t)out->M() * n, out->Row(n), out->M());
+	}
+	return WritePGM(file, buf);
+}
 
-		if (newline) {
-			newline = false;
-			if (in == '#') {
-				comment = true;
-				continue;
+int SavePGM(std::string file, Image<uint16_t>* out, int maxval) {
+	if (maxval < 1 || maxval > 65535) {
+		return ERROR_PGM_MAXSIZE;
+	}
+	ArenaBuffer<byte> buf;
+	byte* dst = PGMBuffer(buf, out->M(), out->N(), maxval);
+	int width = out->M();
+	for (int n = 0; n < out->N(); ++n) {
+		const uint16_t* src = out->Row(n);
+		if (maxval > 255) {
+			byte* row = dst + (size_t)2 * width * n;
+			for (int m = 0; m < width; ++m) {
+				row[2 * m] = (byte)(src[m] >> 8);
+				row[2 * m + 1] = (byte)src[m];
 			}
 		}
-
-		if (comment) {
-			if (in == '\n') {
-				comment = false;
-				newline = true;
-			}
-			continue;
+		else {
+			byte* row = dst + (size_t)width * n;
+			for (int m = 0; m < width; ++m) { row[m] = (byte)src[m]; }
 		}
+	}
+	return WritePGM(file, buf);
+}
 
-		switch (state) {
-			case ParsePGM::Width:
-				if (in == ' ' || in == '\n' || in == '\t' || in == 0) {
-					state = ParsePGM::Height;
-					break;
-				}
-				if (in < '0' || in > '9') {
-					delete iin;
-					fin.close();
-					return ERROR_PGM_HEADER;
-				}
-				iin->width *= 10;
-				iin->width += in - '0';
-				break;
-
-			case ParsePGM::Height:
-				if (in == ' ' || in == '\n' || in == '\t' || in == 0) {
-					state = ParsePGM::MaxVal;
-					break;
-				}
-				if (in < '0' || in > '9') {
-					delete iin;
-					fin.close();
-					return ERROR_PGM_HEADER;
-				}
-				iin->height *= 10;
-				iin->height += in - '0';
-				break;
-
-			case ParsePGM::MaxVal:
-				if (in == ' ' || in == '\n' || in == '\t' || in == 0) {
-					state = ParsePGM::Data;
-					if (maxsize != 255) {
-						delete iin;
-						fin.close();
-						return ERROR_PGM_HEADER | ERROR_PGM_MAXSIZE;
-					}
-
-					iin->length = iin->width * iin->height;
-					iin->image = new byte[iin->length];
-					break;
-				}
-				if (in < '0' || in > '9') {
-					delete iin;
-					fin.close();
-					return ERROR_PGM_HEADER;
-				}
-				maxsize *= 10;
-				maxsize += in - '0';
-				break;
-		}
+// Header prefixes tried by PGMReader, doubling up to the largest (only comments make a header this long)
+#define PGM_HEADER_MIN 4096
+#define PGM_HEADER_MAX (1 << 20)
+
+PGMReader::PGMReader() {
+	file = nullptr;
+	width = height = 0;
+}
 
-		if (state == ParsePGM::Data) { break; }
+PGMReader::~PGMReader() {
+	close();
+}
+
+int PGMReader::open(std::string path) {
+	close();
+	file = fopen(path.c_str(), "rb");
+	if (file == nullptr) {
+		return ERROR_PGM_FILE;
 	}
 
-	fin.read((char*)iin->image, iin->length);
-	fin.close();
+	std::vector<byte> prefix;
+	int maxval = 0, err = ERROR_PGM_HEADER;
+	size_t offset = 0;
+	for (size_t size = PGM_HEADER_MIN; size <= PGM_HEADER_MAX; size *= 2) {
+		prefix.resize(size);
+		fseek(file, 0, SEEK_SET);
+		size_t got = fread(prefix.data(), 1, size, file);
+		err = ParsePGMHeader(prefix.data(), got, width, height, maxval, offset);
+		if (err == ERROR_NONE || got < size) { break; }
+	}
+	if (err == ERROR_NONE && maxval > 255) { err = ERROR_PGM_HEADER | ERROR_PGM_MAXSIZE; }
+	if (err != ERROR_NONE) {
+		close();
+		return err;
+	}
+	fseek(file, (long)offset, SEEK_SET);
+	return ERROR_NONE;
+}
 
-	*out = iin;
-	return 0;
+int PGMReader::read(byte* dst, int rows) {
+	size_t bytes = (size_t)width * rows;
+	if (file == nullptr || fread(dst, 1, bytes, file) != bytes) {
+		return ERROR_PGM_TRUNCATED;
+	}
+	return ERROR_NONE;
 }
 
-int SavePGM(std::string file, Image<byte>* out) {
-	std::fstream fout(file, std::ios::binary | std::ios::out);
-	fout << "P5\n" << out->width << ' ' << out->height << " 255\n";
-	fout.write((char*)out->image, out->length);
-	fout.close();
-	return 0;
+void PGMReader::close() {
+	if (file != nullptr) { fclose(file); }
+	file = nullptr;
+}
+
+PGMWriter::PGMWriter() {
+	file = nullptr;
+	width = 0;
+}
+
+PGMWriter::~PGMWriter() {
+	close();
+}
+
+int PGMWriter::open(std::string path, int w, int h) {
+	close();
+	file = fopen(path.c_str(), "wb");
+	if (file == nullptr) {
+		return ERROR_PGM_FILE;
+	}
+	width = w;
+	if (fprintf(file, "P5\n%d %d 255\n", w, h) < 0) {
+		close();
+		return ERROR_PGM_FILE;
+	}
+	return ERROR_NONE;
+}
+
+int PGMWriter::write(const byte* src, int rows) {
+	size_t bytes = (size_t)width * rows;
+	if (file == nullptr || fwrite(src, 1, bytes, file) != bytes) {
+		return ERROR_PGM_FILE;
+	}
+	return ERROR_NONE;
+}
+
+int PGMWriter::close() {
+	int err = ERROR_NONE;
+	if (file != nullptr && fclose(file) != 0) { err = ERROR_PGM_FILE; }
+	file = nullptr;
+	return err;
 }
@@ -1,122 +1,322 @@
 #pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include "arena.hpp"
+#include "mapreduce.hpp"
+#include "pool.hpp"
 #include "types.h"
 
+// Pixels are stored row by row, Stride() elements apart. Owned storage is STORAGE_ALIGN aligned and every row is
+// padded to a multiple of STORAGE_ALIGN bytes, so each row starts aligned too. It comes from the thread's current
+// BufferArena if one is installed (see ArenaScope), and the arena has to outlive the image.
 template <typename T>
 class Image {
 private:
+	inline size_t bytes() const {
+		return (size_t)stride * height * sizeof(T);
+	}
+	inline void allocate(int w, int h) {
+		width = w;
+		height = h;
+		length = width * height;
+		stride = STORAGE_ALIGN % sizeof(T) == 0 ? (int)((w * sizeof(T) + STORAGE_ALIGN - 1) / STORAGE_ALIGN * (STORAGE_ALIGN / sizeof(T))) : w;
+		image = (T*)StorageAlloc(bytes(), arena);
+	}
 	inline void clean() {
-		delete[] image;
+		if (owner) { owner.reset(); }
+		else { StorageFree(image, bytes(), arena); }
 		image = nullptr;
-		width = height = length = 0;
+		arena = nullptr;
+		width = height = length = stride = 0;
 	}
 	inline void copy(const Image<T>& rhs) {
+		allocate(rhs.width, rhs.height);
+		for (int n = 0; n < height; ++n) {
+			memcpy(Row(n), rhs.Row(n), sizeof(T) * width);
+		}
+	}
+	// Steal rhs's storage (views stay views), rhs is left empty
+	inline void take(Image<T>& rhs) {
 		width = rhs.width;
 		height = rhs.height;
-		length = width * height;
-		image = new T[length];
-		//memcpy_s(image, sizeof(T) * length, rhs.image, sizeof(T) * length);
-		memcpy(image, rhs.image, sizeof(T) * length);
+		length = rhs.length;
+		stride = rhs.stride;
+		image = rhs.image;
+		arena = rhs.arena;
+		owner = std::move(rhs.owner);
+		rhs.image = nullptr;
+		rhs.arena = nullptr;
+		rhs.width = rhs.height = rhs.length = rhs.stride = 0;
 	}
 
 protected:
 	int width, height, length;
+	int stride;                  // elements from one row to the next
 	T* image;
+	BufferArena* arena;          // where owned storage goes back to, nullptr for the heap
+	std::shared_ptr<void> owner; // set for views, keeps the memory image points into alive
 
 	Image() {
 		width = 0;
 		height = 0;
 		length = 0;
+		stride = 0;
 		image = nullptr;
+		arena = nullptr;
 	}
 
 public:
-	friend int OpenPGM(std::string, Image<byte>**);
-	friend int SavePGM(std::string, Image<byte>*);
-
 	typedef std::function<void(int, int, T)> accessor;
 	typedef std::function<T(int, int, T)> mutator;
 	typedef std::function<T(int, int)> setter;
 
 	inline void each(accessor f) const {
-		int i = 0;
 		for (int n = 0; n < height; ++n) {
+			const T* row = Row(n);
 			for (int m = 0; m < width; ++m) {
-				f(m, n, image[i++]);
+				f(m, n, row[m]);
 			}
 		}
 	}
 	inline void each(mutator f) {
-		int i = 0;
 		for (int n = 0; n < height; ++n) {
+			T* row = Row(n);
 			for (int m = 0; m < width; ++m) {
-				image[i] = f(m, n, image[i]);
-				++i;
+				row[m] = f(m, n, row[m]);
 			}
 		}
 	}
-	Image(int w, int h, setter f) {
-		width = w;
-		height = h;
-		length = width * height;
-		image = new T[length];
-		int i = 0;
+	// Parallel versions of the per-pixel passes, split into row blocks on pool (f must be safe to call concurrently)
+	inline void each(mutator f, ThreadPool& pool) {
+		pool.Rows(height, [this, &f](int n0, int n1) -> void {
+			for (int n = n0; n < n1; ++n) {
+				T* row = Row(n);
+				for (int m = 0; m < width; ++m) {
+					row[m] = f(m, n, row[m]);
+				}
+			}
+		});
+	}
+
+	// Functor passes, split into row blocks on pool (f must be safe to call concurrently)
+	// f is inlined into the row loops, unlike each(), so simple bodies vectorize and run at memory bandwidth
+
+	// v = f(v) for every pixel
+	template<typename F>
+	void map(F f, ThreadPool& pool = ThreadPool::Shared()) {
+		pool.Rows(height, [this, &f](int n0, int n1) -> void {
+			for (int n = n0; n < n1; ++n) { MapRange(Row(n), width, f); }
+		});
+	}
+	// v = f(v, u) for every pixel v and the pixel u of other at the same position (other has the same size)
+	template<typename U, typename F>
+	void zip_map(const Image<U>& other, F f, ThreadPool& pool = ThreadPool::Shared()) {
+		pool.Rows(height, [this, &other, &f](int n0, int n1) -> void {
+			for (int n = n0; n < n1; ++n) { ZipRange(Row(n), other.Row(n), width, f); }
+		});
+	}
+	// f folded over every pixel (converted to R) from init, see ReduceRange for what f and init have to be
+	template<typename R, typename F>
+	R reduce(R init, F f, ThreadPool& pool = ThreadPool::Shared()) const {
+		R total = init;
+		std::mutex lock;
+		pool.Rows(height, [this, init, &f, &total, &lock](int n0, int n1) -> void {
+			R part = init;
+			for (int n = n0; n < n1; ++n) { part = f(part, ReduceRange(Row(n), width, init, f)); }
+			std::lock_guard<std::mutex> guard(lock);
+			total = f(total, part);
+		});
+		return total;
+	}
+
+	inline T Min(ThreadPool& pool = ThreadPool::Shared()) const { return length > 0 ? reduce(Row(0)[0], ReduceMin(), pool) : 0; }
+	inline T Max(ThreadPool& pool = ThreadPool::Shared()) const { return length > 0 ? reduce(Row(0)[0], ReduceMax(), pool) : 0; }
+	inline double Sum(ThreadPool& pool = ThreadPool::Shared()) const { return reduce(0.0, ReduceSum(), pool); }
+	// Largest pixel and the first position (row-major) that holds it
+	T ArgMax(int& m, int& n, ThreadPool& pool = ThreadPool::Shared()) const {
+		m = n = 0;
+		T best = Max(pool);
+		for (int k = 0; k < height; ++k) {
+			const T* row = Row(k);
+			for (int l = 0; l < width; ++l) {
+				if (row[l] == best) {
+					m = l;
+					n = k;
+					return best;
+				}
+			}
+		}
+		return best;
+	}
+
+	// Pixels set to f(m, n), f is any functor (a setter works too) and is inlined into the row loops.
+	// Only enabled when f(m, n) is a call, so values and pointers still pick the constructors below.
+	template<typename F, typename = decltype(std::declval<F&>()(0, 0))>
+	Image(int w, int h, F f, ThreadPool& pool) {
+		allocate(w, h);
+		pool.Rows(height, [this, &f](int n0, int n1) -> void {
+			for (int n = n0; n < n1; ++n) {
+				T* row = Row(n);
+				for (int m = 0; m < width; ++m) {
+					row[m] = f(m, n);
+				}
+			}
+		});
+	}
+
+	template<typename F, typename = decltype(std::declval<F&>()(0, 0))>
+	Image(int w, int h, F f) {
+		allocate(w, h);
 		for (int n = 0; n < height; ++n) {
+			T* row = Row(n);
 			for (int m = 0; m < width; ++m) {
-				image[i++] = f(m, n);
+				row[m] = f(m, n);
 			}
 		}
 	}
 
+	// Zeroed, padding included
 	Image(int w, int h) {
-		width = w;
-		height = h;
-		length = width * height;
-		image = new T[length]();
+		allocate(w, h);
+		memset(image, 0, bytes());
 	}
 	Image(int w, int h, T v) {
-		width = w;
-		height = h;
-		length = width * height;
-		image = new T[length];
-		int i = 0;
+		allocate(w, h);
 		for (int n = 0; n < height; ++n) {
+			T* row = Row(n);
 			for (int m = 0; m < width; ++m) {
-				image[i++] = v;
+				row[m] = v;
 			}
 		}
 	}
+	// Copy of the w x h pixels at img (rows w apart)
 	Image(int w, int h, T* img) {
+		allocate(w, h);
+		for (int n = 0; n < height; ++n) {
+			memcpy(Row(n), img + (size_t)w * n, sizeof(T) * w);
+		}
+	}
+	// View of the w x h pixels at img with rows ld elements apart (w if 0), nothing is copied and img stays valid
+	// as long as keep (or a copy of it) does
+	Image(int w, int h, T* img, std::shared_ptr<void> keep, int ld = 0) {
 		width = w;
 		height = h;
 		length = width * height;
-		image = new T[length];
-		memcpy(image, img, sizeof(T) * length);
+		stride = ld > 0 ? ld : w;
+		image = img;
+		arena = nullptr;
+		owner = keep;
+	}
+	// Copies of views own their pixels, moves take the storage (or the view) as it is
+	Image<T>& operator=(const Image<T>& rhs) {
+		if (this != &rhs) {
+			clean();
+			copy(rhs);
+		}
+		return *this;
+	}
+	Image<T>& operator=(Image<T>&& rhs) {
+		if (this != &rhs) {
+			clean();
+			take(rhs);
+		}
+		return *this;
 	}
-	Image<T>& operator=(const Image<T>& rhs) { clean(); copy(rhs); return *this; }
 	Image(const Image<T>& rhs) { copy(rhs); }
+	Image(Image<T>&& rhs) { take(rhs); }
 	~Image() { clean(); }
 
 	inline const int M() const { return width; }
 	inline const int N() const { return height; }
 
+	inline bool View() const { return owner != nullptr; }
+
 	inline const int ConvTailM() const { return width / 2; }
 	inline const int ConvTailN() const { return height / 2; }
 
+	// Elements from one row to the next (at least M())
+	inline int Stride() const { return stride; }
+
+	// Raw row access for the inner loops (no bounds checks, rows are Stride() elements apart)
+	inline T* Row(int n) { return image + (size_t)stride * n; }
+	inline const T* Row(int n) const { return image + (size_t)stride * n; }
+
 	inline T Get(int m, int n) const {
 		if (m < 0 || n < 0 || m >= width || n >= height || image == nullptr) { return 0; }
-		return image[width*n + m];
+		return image[(size_t)stride * n + m];
 	}
 	inline void Set(int m, int n, T val) {
 		if (m < 0 || n < 0 || m >= width || n >= height || image == nullptr) { return; }
-		image[width*n + m] = val;
+		image[(size_t)stride * n + m] = val;
 	}
 };
 
 #define ERROR_PGM_FILE          (1 << 0)
 #define ERROR_PGM_HEADER        (1 << 1)
 #define ERROR_PGM_MAXSIZE       (1 << 2)
+#define ERROR_PGM_SIZE          (1 << 3) // more pixels than an Image can index
+#define ERROR_PGM_TRUNCATED     (1 << 4)
 
+// P5 files are memory mapped and their header parsed in place
+// The 8-bit loader returns a view straight into the (copy-on-write) mapping, the pixels are never copied and the
+// file stays mapped until the image is deleted. The 16-bit loader takes either depth, 16-bit files are big-endian
+// so it converts while copying into an owned image.
 int OpenPGM(std::string, Image<byte>**);
+int OpenPGM(std::string, Image<uint16_t>**);
+
+// Header and pixels go out in one checked write, ERROR_PGM_FILE if the file can't be created or written in full
 int SavePGM(std::string, Image<byte>*);
+int SavePGM(std::string, Image<uint16_t>*, int maxval = 65535);
+
+// Parse the P5 header at the start of the size bytes at p (any depth), offset is where the pixels start
+int ParsePGMHeader(const byte* p, size_t size, int& width, int& height, int& maxval, size_t& offset);
+
+// Reads an 8-bit P5 file a band of rows at a time, for images that don't have to fit in memory
+class PGMReader {
+private:
+	std::FILE* file;
+	int width, height;
+
+public:
+	PGMReader();
+	~PGMReader();
+
+	PGMReader(const PGMReader& rhs) = delete;
+	PGMReader& operator=(PGMReader const& rhs) = delete;
+
+	int open(std::string path);
+	void close();
+
+	inline int M() const { return width; }
+	inline int N() const { return height; }
+
+	// The next rows rows of pixels into dst (rows * M() bytes)
+	int read(byte* dst, int rows);
+};
+
+// Writes an 8-bit P5 file a band of rows at a time
+class PGMWriter {
+private:
+	std::FILE* file;
+	int width;
+
+public:
+	PGMWriter();
+	~PGMWriter();
+
+	PGMWriter(const PGMWriter& rhs) = delete;
+	PGMWriter& operator=(PGMWriter const& rhs) = delete;
+
+	int open(std::string path, int w, int h);
+	// Fails if the buffered tail can't be written
+	int close();
+
+	// The next rows rows of pixels from src (rows * w bytes)
+	int write(const byte* src, int rows);
+};
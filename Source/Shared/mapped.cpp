@@ -0,0 +1,77 @@
+#include "mapped.hpp"
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {
+	data = nullptr;
+	size = 0;
+#if defined(_WIN32)
+	file = INVALID_HANDLE_VALUE;
+	mapping = nullptr;
+#else
+	file = -1;
+#endif
+}
+
+#if defined(_WIN32)
+
+MappedFile::~MappedFile() {
+	if (data != nullptr) { UnmapViewOfFile(data); }
+	if (mapping != nullptr) { CloseHandle(mapping); }
+	if (file != INVALID_HANDLE_VALUE) { CloseHandle(file); }
+}
+
+MappedFile* MappedFile::Open(std::string path) {
+	MappedFile* f = new MappedFile();
+	f->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	LARGE_INTEGER size;
+	if (f->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(f->file, &size) || size.QuadPart == 0) {
+		delete f;
+		return nullptr;
+	}
+	f->size = (size_t)size.QuadPart;
+	f->mapping = CreateFileMappingA(f->file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	if (f->mapping != nullptr) { f->data = (byte*)MapViewOfFile(f->mapping, FILE_MAP_COPY, 0, 0, 0); }
+	if (f->data == nullptr) {
+		delete f;
+		return nullptr;
+	}
+	return f;
+}
+
+#else
+
+MappedFile::~MappedFile() {
+	if (data != nullptr) { munmap(data, size); }
+	if (file >= 0) { close(file); }
+}
+
+MappedFile* MappedFile::Open(std::string path) {
+	MappedFile* f = new MappedFile();
+	f->file = open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (f->file < 0 || fstat(f->file, &st) != 0 || st.st_size == 0) {
+		delete f;
+		return nullptr;
+	}
+	f->size = (size_t)st.st_size;
+	void* p = mmap(nullptr, f->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, f->file, 0);
+	if (p == MAP_FAILED) {
+		delete f;
+		return nullptr;
+	}
+	f->data = (byte*)p;
+	// Loaders read the pixels front to back
+	madvise(p, f->size, MADV_SEQUENTIAL);
+	return f;
+}
+
+#endif
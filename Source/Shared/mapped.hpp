@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include "types.h"
+
+// A whole file mapped into memory for reading
+// Files are mapped copy-on-write, writes through Data() land in private pages and never reach the file, so views
+// into the mapping can be handed out as ordinary mutable buffers. Output isn't mapped, a write fault on a mapping
+// (full disk, I/O error) is a SIGBUS rather than an error code, see SavePGM.
+class MappedFile {
+private:
+	byte* data;
+	size_t size;
+#if defined(_WIN32)
+	void* file;
+	void* mapping;
+#else
+	int file;
+#endif
+
+	MappedFile();
+
+public:
+	~MappedFile();
+
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(MappedFile const& rhs) = delete;
+
+	// nullptr if the file can't be opened or mapped
+	static MappedFile* Open(std::string path);
+
+	inline byte* Data() { return data; }
+	inline const byte* Data() const { return data; }
+	inline size_t Size() const { return size; }
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+// Flat loops behind the map, zip_map and reduce passes of Image and Signal
+// The functor is a template parameter, so it inlines and simple bodies vectorize (no std::function call per item).
+
+// p[i] = f(p[i])
+template<typename T, typename F>
+inline void MapRange(T* p, int n, F& f) {
+	for (int i = 0; i < n; ++i) {
+		p[i] = f(p[i]);
+	}
+}
+
+// p[i] = f(p[i], q[i])
+template<typename T, typename U, typename F>
+inline void ZipRange(T* p, const U* q, int n, F& f) {
+	for (int i = 0; i < n; ++i) {
+		p[i] = f(p[i], q[i]);
+	}
+}
+
+// Independent partial results per reduction, a single running value is a dependency chain the compiler can't
+// vectorize without reassociating (which it won't do for floats)
+#define REDUCE_LANES 16
+
+// f(... f(f(init, p[0]), p[1]) ..., p[n - 1]) in REDUCE_LANES interleaved partials, so f has to be associative
+// and commutative and init its identity (0 for sums, any item for min and max)
+template<typename R, typename T, typename F>
+inline R ReduceRange(const T* p, int n, R init, F& f) {
+	R acc[REDUCE_LANES];
+	for (int k = 0; k < REDUCE_LANES; ++k) { acc[k] = init; }
+	int i = 0;
+	for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+		for (int k = 0; k < REDUCE_LANES; ++k) {
+			acc[k] = f(acc[k], (R)p[i + k]);
+		}
+	}
+	for (; i < n; ++i) {
+		acc[0] = f(acc[0], (R)p[i]);
+	}
+	for (int k = 1; k < REDUCE_LANES; ++k) {
+		acc[0] = f(acc[0], acc[k]);
+	}
+	return acc[0];
+}
+
+// Functors for the common reductions
+struct ReduceMin {
+	template<typename R>
+	inline R operator()(R a, R b) const { return b < a ? b : a; }
+};
+struct ReduceMax {
+	template<typename R>
+	inline R operator()(R a, R b) const { return b > a ? b : a; }
+};
+struct ReduceSum {
+	template<typename R>
+	inline R operator()(R a, R b) const { return a + b; }
+};
@@ -0,0 +1,75 @@
+#include "match.hpp"
+#include <algorithm>
+#include <cmath>
+
+void TemplateMatcher::normalize(Image<float>* score, const std::vector<double>& S, const std::vector<double>& S2, int MI, ThreadPool& pool) const {
+	int MO = score->M();
+	int W = MI + 1;
+	double count = (double)MT * NT;
+	pool.Rows(score->N(), [&](int n0, int n1) -> void {
+		for (int n = n0; n < n1; ++n) {
+			float* row = score->Row(n);
+			const double* s0 = &S[n * W];
+			const double* s1 = &S[(n + NT) * W];
+			const double* q0 = &S2[n * W];
+			const double* q1 = &S2[(n + NT) * W];
+			for (int m = 0; m < MO; ++m) {
+				double sum = s1[m + MT] - s1[m] - s0[m + MT] + s0[m];
+				double sum2 = q1[m + MT] - q1[m] - q0[m + MT] + q0[m];
+				double var = sum2 - sum * sum / count;
+				// Flat windows, including the round off left over from the table differences
+				if (var <= 1e-9 * sum2 || norm == 0) {
+					row[m] = 0;
+					continue;
+				}
+				double ncc = row[m] / (sqrt(var) * norm);
+				row[m] = (float)(ncc > 1 ? 1 : ncc < -1 ? -1 : ncc);
+			}
+		}
+	});
+}
+
+std::vector<MatchPeak> TemplateMatcher::Peaks(Image<float>* score, int K, float threshold, int radius) const {
+	int MO = score->M();
+	int NO = score->N();
+	int rm = radius < 0 ? MT / 2 : radius;
+	int rn = radius < 0 ? NT / 2 : radius;
+
+	// Candidates are the 8-neighbourhood maxima above threshold
+	std::vector<MatchPeak> candidates;
+	for (int n = 0; n < NO; ++n) {
+		const float* row = score->Row(n);
+		for (int m = 0; m < MO; ++m) {
+			float v = row[m];
+			if (v <= threshold) { continue; }
+			bool peak = true;
+			for (int k = n > 0 ? n - 1 : 0; k <= n + 1 && k < NO && peak; ++k) {
+				const float* r = score->Row(k);
+				for (int l = m > 0 ? m - 1 : 0; l <= m + 1 && l < MO; ++l) {
+					if (r[l] > v) {
+						peak = false;
+						break;
+					}
+				}
+			}
+			if (peak) { candidates.push_back({ m, n, v }); }
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const MatchPeak& a, const MatchPeak& b) -> bool {
+		return a.score > b.score;
+	});
+
+	std::vector<MatchPeak> peaks;
+	for (const MatchPeak& c : candidates) {
+		if ((int)peaks.size() >= K) { break; }
+		bool suppressed = false;
+		for (const MatchPeak& p : peaks) {
+			if (abs(c.m - p.m) <= rm && abs(c.n - p.n) <= rn) {
+				suppressed = true;
+				break;
+			}
+		}
+		if (!suppressed) { peaks.push_back(c); }
+	}
+	return peaks;
+}
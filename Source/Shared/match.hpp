@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+#include "convbank.hpp"
+#include "image.hpp"
+#include "pool.hpp"
+
+// Template placement found by TemplateMatcher, (m, n) is the template's top left corner in the image
+struct MatchPeak {
+	int m, n;
+	float score;
+};
+
+// Normalized cross-correlation of a fixed template against images
+// score(m, n) = sum (I - mean_I)(T - mean_T) / sqrt(sum (I - mean_I)^2 sum (T - mean_T)^2) over the template
+// window at (m, n), in [-1, 1] and unchanged by gain and offset of the image brightness.
+// The numerator is a correlation with the zero mean template (the transform is picked by Conv2DBank and the
+// template spectrum cached), the window means and variances come from summed-area tables, so the cost per
+// output pixel doesn't grow with the template size.
+class TemplateMatcher {
+private:
+	int MT, NT;
+	double norm; // sqrt(sum (T - mean_T)^2)
+	Conv2DBank* bank;
+
+	// Summed-area tables of I and I^2, (MI + 1) x (NI + 1) with a zero first row and column
+	template<typename T>
+	static void integrate(Image<T>* image, std::vector<double>& S, std::vector<double>& S2) {
+		int MI = image->M();
+		int NI = image->N();
+		S.assign((MI + 1) * (NI + 1), 0);
+		S2.assign((MI + 1) * (NI + 1), 0);
+		for (int n = 0; n < NI; ++n) {
+			const T* row = image->Row(n);
+			double sum = 0, sum2 = 0;
+			for (int m = 0; m < MI; ++m) {
+				double v = (double)row[m];
+				sum += v;
+				sum2 += v * v;
+				S[(n + 1) * (MI + 1) + m + 1] = S[n * (MI + 1) + m + 1] + sum;
+				S2[(n + 1) * (MI + 1) + m + 1] = S2[n * (MI + 1) + m + 1] + sum2;
+			}
+		}
+	}
+
+	void normalize(Image<float>* score, const std::vector<double>& S, const std::vector<double>& S2, int MI, ThreadPool& pool) const;
+
+public:
+	template<typename T>
+	TemplateMatcher(Image<T>* templ) {
+		MT = templ->M();
+		NT = templ->N();
+		std::vector<float> t;
+		Conv2DFloat(templ, t);
+
+		double mean = 0;
+		for (float v : t) { mean += v; }
+		mean /= t.size();
+		norm = 0;
+		for (float v : t) { norm += (v - mean) * (v - mean); }
+		norm = sqrt(norm);
+
+		// Convolving with the flipped template correlates with it
+		Image<float>* flipped = new Image<float>(MT, NT, [&t, mean, this](int m, int n) -> float {
+			return (float)(t[(NT - 1 - n) * MT + (MT - 1 - m)] - mean);
+		});
+		bank = new Conv2DBank(std::vector<Image<float>*>(1, flipped));
+		delete flipped;
+	}
+	~TemplateMatcher() {
+		delete bank;
+	}
+
+	TemplateMatcher(const TemplateMatcher& rhs) = delete;
+	TemplateMatcher& operator=(TemplateMatcher const& rhs) = delete;
+
+	inline int M() const { return MT; }
+	inline int N() const { return NT; }
+
+	// Score map over every placement with the template inside the image, (MI - MT + 1) x (NI - NT + 1)
+	// Flat windows (and a flat template) score 0
+	template<typename T>
+	Image<float>* Score(Image<T>* image, ThreadPool& pool = ThreadPool::Shared()) {
+		std::vector<double> S, S2;
+		integrate(image, S, S2);
+		Image<float>* score = bank->Apply(image, ConvMode::Valid, pool)[0];
+		normalize(score, S, S2, image->M(), pool);
+		return score;
+	}
+
+	// Up to K local maxima of the score map above threshold, best first
+	// Greedy non-maximum suppression, a peak within radius (in both m and n) of a better one is dropped
+	// radius < 0 uses half the template size
+	std::vector<MatchPeak> Peaks(Image<float>* score, int K, float threshold = 0, int radius = -1) const;
+};
@@ -0,0 +1,175 @@
+#include "pool.hpp"
+#include <chrono>
+#include <cstdlib>
+
+// Index of the queue owned by the current thread (0 for threads outside any pool)
+static thread_local int poolQueue = 0;
+static thread_local const void* poolOwner = nullptr;
+
+ThreadPool::ThreadPool(int threads) {
+	pending = 0;
+	stop = false;
+	start(threads > 0 ? threads : DefaultSize());
+}
+
+ThreadPool::~ThreadPool() {
+	shutdown();
+}
+
+ThreadPool& ThreadPool::Shared() {
+	static ThreadPool pool;
+	return pool;
+}
+
+int ThreadPool::DefaultSize() {
+	const char* env = getenv("DSIP_THREADS");
+	if (env != nullptr && atoi(env) > 0) {
+		return atoi(env);
+	}
+	int hw = (int)std::thread::hardware_concurrency();
+	return hw > 0 ? hw : 1;
+}
+
+void ThreadPool::Resize(int threads) {
+	shutdown();
+	start(threads > 0 ? threads : DefaultSize());
+}
+
+void ThreadPool::start(int threads) {
+	stop = false;
+	queues.clear();
+	for (int i = 0; i < threads; ++i) {
+		queues.emplace_back(new Queue());
+	}
+	for (int i = 1; i < threads; ++i) {
+		workers.emplace_back(&ThreadPool::worker, this, i);
+	}
+}
+
+void ThreadPool::shutdown() {
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+		stop = true;
+	}
+	wake.notify_all();
+	for (std::thread& t : workers) {
+		t.join();
+	}
+	workers.clear();
+}
+
+bool ThreadPool::pop(int q, Task& task) {
+	int Q = (int)queues.size();
+
+	// Own queue from the back (most recently pushed, still warm in cache)
+	{
+		Queue* own = queues[q].get();
+		std::lock_guard<std::mutex> lock(own->lock);
+		if (!own->tasks.empty()) {
+			task = own->tasks.back();
+			own->tasks.pop_back();
+			--pending;
+			return true;
+		}
+	}
+
+	// Steal from the front of everyone else
+	for (int i = 1; i < Q; ++i) {
+		Queue* victim = queues[(q + i) % Q].get();
+		std::lock_guard<std::mutex> lock(victim->lock);
+		if (!victim->tasks.empty()) {
+			task = victim->tasks.front();
+			victim->tasks.pop_front();
+			--pending;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::execute(const Task& task) {
+	(*task.batch->f)(task.index);
+	if (--task.batch->remaining == 0) {
+		std::lock_guard<std::mutex> lock(doneLock);
+		done.notify_all();
+	}
+}
+
+void ThreadPool::worker(int q) {
+	poolQueue = q;
+	poolOwner = this;
+	Task task;
+	while (true) {
+		if (pop(q, task)) {
+			execute(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepLock);
+		wake.wait(lock, [this]() -> bool { return stop || pending > 0; });
+		if (stop) { return; }
+	}
+}
+
+void ThreadPool::Run(int count, const std::function<void(int)>& f) {
+	if (count <= 0) { return; }
+
+	int Q = (int)queues.size();
+	if (count == 1 || Q == 1) {
+		for (int i = 0; i < count; ++i) { f(i); }
+		return;
+	}
+
+	Batch batch;
+	batch.f = &f;
+	batch.remaining = count;
+
+	// Deal out contiguous blocks of indices to every queue so neighbouring tiles start on the same thread
+	for (int q = 0; q < Q; ++q) {
+		int i0 = (int)((long long)count * q / Q);
+		int i1 = (int)((long long)count * (q + 1) / Q);
+		if (i0 == i1) { continue; }
+		Queue* queue = queues[q].get();
+		std::lock_guard<std::mutex> lock(queue->lock);
+		for (int i = i1 - 1; i >= i0; --i) {
+			queue->tasks.push_back(Task{ &batch, i });
+		}
+		pending += i1 - i0;
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+	}
+	wake.notify_all();
+
+	// Help out until our batch is finished
+	int q = poolOwner == this ? poolQueue : 0;
+	Task task;
+	while (batch.remaining > 0) {
+		if (pop(q, task)) {
+			execute(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(doneLock);
+		done.wait_for(lock, std::chrono::milliseconds(1), [&batch]() -> bool { return batch.remaining == 0; });
+	}
+}
+
+void ThreadPool::Tiles(int M, int N, int tm, int tn, const std::function<void(int, int, int, int)>& f) {
+	if (M <= 0 || N <= 0) { return; }
+	int TM = (M + tm - 1) / tm;
+	int TN = (N + tn - 1) / tn;
+	Run(TM * TN, [&](int i) -> void {
+		int m0 = (i % TM) * tm;
+		int n0 = (i / TM) * tn;
+		f(m0, m0 + tm < M ? m0 + tm : M, n0, n0 + tn < N ? n0 + tn : N);
+	});
+}
+
+void ThreadPool::Rows(int N, const std::function<void(int, int)>& f) {
+	if (N <= 0) { return; }
+	int blocks = Size() * 4;
+	if (blocks > N) { blocks = N; }
+	Run(blocks, [&](int i) -> void {
+		f((int)((long long)N * i / blocks), (int)((long long)N * (i + 1) / blocks));
+	});
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Long-lived worker pool with per-worker deques and work stealing
+// The calling thread always helps run its own batch, so nested Run() calls from inside a task are fine
+class ThreadPool {
+private:
+	struct Batch {
+		const std::function<void(int)>* f;
+		std::atomic<int> remaining;
+	};
+	struct Task {
+		Batch* batch;
+		int index;
+	};
+	struct Queue {
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<Queue>> queues; // queues[0] is fed by non-worker threads
+	std::atomic<int> pending;
+	std::atomic<bool> stop;
+
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::mutex doneLock;
+	std::condition_variable done;
+
+	void start(int threads);
+	void shutdown();
+	void worker(int q);
+	bool pop(int q, Task& task);
+	void execute(const Task& task);
+
+public:
+	// threads <= 0 uses DefaultSize()
+	ThreadPool(int threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool& rhs) = delete;
+	ThreadPool& operator=(ThreadPool const& rhs) = delete;
+
+	// Process-wide pool shared by the convolution and image routines
+	static ThreadPool& Shared();
+
+	// DSIP_THREADS from the environment if set, otherwise std::thread::hardware_concurrency()
+	static int DefaultSize();
+
+	// Number of threads that run tasks, including the caller of Run()
+	inline int Size() const { return (int)workers.size() + 1; }
+
+	// Must not be called while a batch is running
+	void Resize(int threads);
+
+	// Run f(0) ... f(count - 1) and block until all are done
+	void Run(int count, const std::function<void(int)>& f);
+
+	// Split [0, M) x [0, N) into tiles of at most tm x tn and run f(m0, m1, n0, n1) on each
+	void Tiles(int M, int N, int tm, int tn, const std::function<void(int, int, int, int)>& f);
+
+	// Split [0, N) into blocks of rows, enough for a few per thread, and run f(n0, n1) on each
+	void Rows(int N, const std::function<void(int, int)>& f);
+};
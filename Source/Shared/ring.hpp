@@ -0,0 +1,121 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// Lock-free single producer, single consumer ring buffer
+// One thread writes and one thread reads, neither ever blocks or allocates. The read and write counters only
+// grow (wrapping is fine for size_t) and are published with release stores, so a side sees the other's data
+// before it sees the counter that covers it. They sit on separate cache lines to keep the two cores from
+// bouncing one line back and forth.
+template<typename T>
+class SpscRing {
+private:
+	T* data;
+	size_t mask;
+	char pad0[64];
+	std::atomic<size_t> head; // next read, advanced by the consumer
+	char pad1[64];
+	std::atomic<size_t> tail; // next write, advanced by the producer
+	char pad2[64];
+
+public:
+	// capacity is rounded up to a power of two
+	SpscRing(int capacity) {
+		size_t size = 1;
+		while (size < (size_t)capacity) { size <<= 1; }
+		data = new T[size]();
+		mask = size - 1;
+		head = 0;
+		tail = 0;
+	}
+	~SpscRing() {
+		delete[] data;
+	}
+
+	SpscRing(const SpscRing& rhs) = delete;
+	SpscRing& operator=(SpscRing const& rhs) = delete;
+
+	inline int Capacity() const { return (int)(mask + 1); }
+
+	// Items ready to read (consumer side) and free slots (producer side), exact for the calling side
+	inline int Available() const {
+		return (int)(tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed));
+	}
+	inline int Space() const {
+		return (int)(mask + 1 - (tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire)));
+	}
+
+	// Producer, copies in as many of the n items as fit and returns how many
+	int Write(const T* src, int n) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t free = mask + 1 - (t - head.load(std::memory_order_acquire));
+		size_t count = (size_t)n < free ? (size_t)n : free;
+		for (size_t i = 0; i < count; ++i) {
+			data[(t + i) & mask] = src[i];
+		}
+		tail.store(t + count, std::memory_order_release);
+		return (int)count;
+	}
+
+	// Consumer, copies out up to n items and returns how many
+	int Read(T* dst, int n) {
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t ready = tail.load(std::memory_order_acquire) - h;
+		size_t count = (size_t)n < ready ? (size_t)n : ready;
+		for (size_t i = 0; i < count; ++i) {
+			dst[i] = data[(h + i) & mask];
+		}
+		head.store(h + count, std::memory_order_release);
+		return (int)count;
+	}
+};
+
+// Blocking bounded queue for pipelines of threads, any number of producers and consumers
+// push() waits for room and pop() for an item. Once close() is called pushes fail and pops drain what's left,
+// then fail, which is how the stages downstream learn they're done.
+template<typename T>
+class BoundedQueue {
+private:
+	std::deque<T> items;
+	int capacity;
+	bool closed;
+	std::mutex lock;
+	std::condition_variable notFull, notEmpty;
+
+public:
+	BoundedQueue(int capacity) : capacity(capacity > 0 ? capacity : 1), closed(false) {}
+
+	BoundedQueue(const BoundedQueue& rhs) = delete;
+	BoundedQueue& operator=(BoundedQueue const& rhs) = delete;
+
+	// False (item not queued) if the queue was closed
+	bool push(const T& item) {
+		std::unique_lock<std::mutex> guard(lock);
+		notFull.wait(guard, [this]() -> bool { return closed || (int)items.size() < capacity; });
+		if (closed) { return false; }
+		items.push_back(item);
+		notEmpty.notify_one();
+		return true;
+	}
+
+	// False once the queue is closed and empty
+	bool pop(T& item) {
+		std::unique_lock<std::mutex> guard(lock);
+		notEmpty.wait(guard, [this]() -> bool { return closed || !items.empty(); });
+		if (items.empty()) { return false; }
+		item = items.front();
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> guard(lock);
+		closed = true;
+		notFull.notify_all();
+		notEmpty.notify_all();
+	}
+};
@@ -0,0 +1,136 @@
+#include "separable.hpp"
+#include <algorithm>
+#include <cmath>
+
+// One-sided Jacobi SVD of the NF x MF matrix A (A[k][l] = F(l, k))
+// Columns of A are rotated until mutually orthogonal, V accumulates the rotations
+// Afterwards A = U S (column norms are the singular values) and F = U S V^T
+static void Jacobi(std::vector<double>& A, std::vector<double>& V, int rows, int cols) {
+	V.assign(cols * cols, 0);
+	for (int i = 0; i < cols; ++i) { V[i * cols + i] = 1; }
+
+	for (int sweep = 0; sweep < 60; ++sweep) {
+		bool rotated = false;
+		for (int p = 0; p < cols - 1; ++p) {
+			for (int q = p + 1; q < cols; ++q) {
+				double alpha = 0, beta = 0, gamma = 0;
+				for (int i = 0; i < rows; ++i) {
+					double ap = A[i * cols + p];
+					double aq = A[i * cols + q];
+					alpha += ap * ap;
+					beta += aq * aq;
+					gamma += ap * aq;
+				}
+				if (gamma == 0 || fabs(gamma) <= 1e-15 * sqrt(alpha * beta)) { continue; }
+				rotated = true;
+
+				double zeta = (beta - alpha) / (2 * gamma);
+				double t = (zeta >= 0 ? 1 : -1) / (fabs(zeta) + sqrt(1 + zeta * zeta));
+				double c = 1 / sqrt(1 + t * t);
+				double s = c * t;
+
+				for (int i = 0; i < rows; ++i) {
+					double ap = A[i * cols + p];
+					double aq = A[i * cols + q];
+					A[i * cols + p] = c * ap - s * aq;
+					A[i * cols + q] = s * ap + c * aq;
+				}
+				for (int i = 0; i < cols; ++i) {
+					double vp = V[i * cols + p];
+					double vq = V[i * cols + q];
+					V[i * cols + p] = c * vp - s * vq;
+					V[i * cols + q] = s * vp + c * vq;
+				}
+			}
+		}
+		if (!rotated) { break; }
+	}
+}
+
+// Rank check around the largest coefficient: F(l, k) = F(l, k*) F(l*, k) / F(l*, k*) when F is rank 1
+// The factors are taken straight from the kernel, so integer kernels like Sobel stay exact
+static bool Pivot(const float* f, int MF, int NF, double tolerance, SeparableKernel& out) {
+	int lp = 0, kp = 0;
+	double total = 0;
+	for (int k = 0; k < NF; ++k) {
+		for (int l = 0; l < MF; ++l) {
+			total += (double)f[k * MF + l] * f[k * MF + l];
+			if (fabs(f[k * MF + l]) > fabs(f[kp * MF + lp])) {
+				lp = l;
+				kp = k;
+			}
+		}
+	}
+	if (total == 0) { return false; }
+
+	double pivot = f[kp * MF + lp];
+	std::vector<float> row(MF), col(NF);
+	for (int l = 0; l < MF; ++l) { row[l] = f[kp * MF + l]; }
+	for (int k = 0; k < NF; ++k) { col[k] = (float)(f[k * MF + lp] / pivot); }
+
+	double residual = 0;
+	for (int k = 0; k < NF; ++k) {
+		for (int l = 0; l < MF; ++l) {
+			double d = f[k * MF + l] - (double)col[k] * row[l];
+			residual += d * d;
+		}
+	}
+	out.error = sqrt(residual / total);
+	if (out.error > tolerance) { return false; }
+
+	out.rows.push_back(row);
+	out.cols.push_back(col);
+	return true;
+}
+
+bool Separate(const float* f, int MF, int NF, double tolerance, int maxRank, SeparableKernel& out) {
+	out = SeparableKernel();
+	out.MF = MF;
+	out.NF = NF;
+
+	if (Pivot(f, MF, NF, tolerance < SEPARABLE_EXACT ? tolerance : SEPARABLE_EXACT, out)) {
+		return true;
+	}
+
+	std::vector<double> A(f, f + MF * NF);
+	std::vector<double> V;
+	Jacobi(A, V, NF, MF);
+
+	// Singular values, largest first
+	std::vector<double> sigma(MF);
+	std::vector<int> order(MF);
+	double total = 0;
+	for (int l = 0; l < MF; ++l) {
+		double s = 0;
+		for (int k = 0; k < NF; ++k) { s += A[k * MF + l] * A[k * MF + l]; }
+		sigma[l] = sqrt(s);
+		order[l] = l;
+		total += s;
+	}
+	std::sort(order.begin(), order.end(), [&sigma](int a, int b) -> bool { return sigma[a] > sigma[b]; });
+
+	if (total == 0) {
+		out.error = 0;
+		return true;
+	}
+
+	// Keep terms until the discarded energy is within tolerance
+	double kept = 0;
+	for (int r = 0; r < MF && r < maxRank; ++r) {
+		int l = order[r];
+		if (sigma[l] == 0) { break; }
+
+		// Split the singular value evenly between the two 1D filters
+		double scale = sqrt(sigma[l]);
+		std::vector<float> row(MF), col(NF);
+		for (int i = 0; i < MF; ++i) { row[i] = (float)(V[i * MF + l] * scale); }
+		for (int k = 0; k < NF; ++k) { col[k] = (float)(A[k * MF + l] / sigma[l] * scale); }
+		out.rows.push_back(row);
+		out.cols.push_back(col);
+
+		kept += sigma[l] * sigma[l];
+		out.error = sqrt(std::max(0.0, total - kept) / total);
+		if (out.error <= tolerance) { return true; }
+	}
+	return out.error <= tolerance;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+
+// Sum of separable terms approximating a 2D kernel, F(l, k) ~= sum_r cols[r][k] * rows[r][l]
+class SeparableKernel {
+public:
+	int MF, NF;
+	std::vector<std::vector<float>> rows; // MF horizontal taps per term
+	std::vector<std::vector<float>> cols; // NF vertical taps per term
+	double error; // relative Frobenius error of the kept terms
+
+	SeparableKernel() {
+		MF = NF = 0;
+		error = 1;
+	}
+
+	inline int Rank() const { return (int)rows.size(); }
+};
+
+// Relative error under which a kernel counts as exactly separable (float round off)
+#define SEPARABLE_EXACT 1e-6
+
+// Decompose the MF x NF row-major kernel f by SVD, keeping the fewest terms whose relative error is within
+// tolerance (never more than maxRank). Returns false if maxRank terms can't meet the tolerance.
+bool Separate(const float* f, int MF, int NF, double tolerance, int maxRank, SeparableKernel& out);
@@ -19,7 +19,7 @@ int OpenBin(std::string file, Signal<float>** iin) {
 
 int SaveBin(std::string file, Signal<float>* out) {
 	std::fstream fout(file, std::ios::binary | std::ios::out);
-	fout.write((char*)out->length, sizeof(int));
+	fout.write((char*)&out->length, sizeof(int));
 	fout.write((char*)out->signal, out->length * sizeof(float));
 	fout.close();
 	return 0;
@@ -1,32 +1,55 @@
 #pragma once
+#include <cstring>
 #include <functional>
+#include <mutex>
 #include <string>
+#include <utility>
+#include "arena.hpp"
+#include "mapreduce.hpp"
+#include "pool.hpp"
 #include "types.h"
 
+// Samples are STORAGE_ALIGN aligned and come from the thread's current BufferArena if one is installed (see Image)
 template <typename T>
 class Signal {
 private:
+	inline void allocate(int l) {
+		length = l;
+		signal = (T*)StorageAlloc(sizeof(T) * length, arena);
+	}
 	inline void clean() {
-		delete[] signal;
+		StorageFree(signal, sizeof(T) * length, arena);
 		signal = nullptr;
+		arena = nullptr;
 		length = 0;
 	}
 	inline void copy(const Signal<T>& rhs) {
-		length = rhs.length;
-		signal = new T[length];
+		allocate(rhs.length);
 		memcpy(signal, rhs.signal, sizeof(T) * length);
 	}
+	// Steal rhs's storage, rhs is left empty
+	inline void take(Signal<T>& rhs) {
+		length = rhs.length;
+		signal = rhs.signal;
+		arena = rhs.arena;
+		rhs.signal = nullptr;
+		rhs.arena = nullptr;
+		rhs.length = 0;
+	}
 
 protected:
 	int length;
 	T* signal;
+	BufferArena* arena; // where the storage goes back to, nullptr for the heap
 
 	Signal() {
 		length = 0;
 		signal = nullptr;
+		arena = nullptr;
 	}
 
 public:
+	template<typename U> friend class Signal;
 	friend int OpenBin(std::string, Signal<float>**);
 	friend int SaveBin(std::string, Signal<float>*);
 
@@ -44,32 +67,92 @@ public:
 			signal[n] = f(n, signal[n]);
 		}
 	}
-	Signal(int l, setter f) {
-		length = l;
-		signal = new T[length];
+
+	// Functor passes like Image's, split into blocks of samples on pool (f must be safe to call concurrently)
+
+	// v = f(v) for every sample
+	template<typename F>
+	void map(F f, ThreadPool& pool = ThreadPool::Shared()) {
+		pool.Rows(length, [this, &f](int n0, int n1) -> void {
+			MapRange(signal + n0, n1 - n0, f);
+		});
+	}
+	// v = f(v, u) for every sample v and the sample u of other at the same position (other has the same length)
+	template<typename U, typename F>
+	void zip_map(const Signal<U>& other, F f, ThreadPool& pool = ThreadPool::Shared()) {
+		pool.Rows(length, [this, &other, &f](int n0, int n1) -> void {
+			ZipRange(signal + n0, other.signal + n0, n1 - n0, f);
+		});
+	}
+	// f folded over every sample (converted to R) from init, see ReduceRange for what f and init have to be
+	template<typename R, typename F>
+	R reduce(R init, F f, ThreadPool& pool = ThreadPool::Shared()) const {
+		R total = init;
+		std::mutex lock;
+		pool.Rows(length, [this, init, &f, &total, &lock](int n0, int n1) -> void {
+			R part = ReduceRange(signal + n0, n1 - n0, init, f);
+			std::lock_guard<std::mutex> guard(lock);
+			total = f(total, part);
+		});
+		return total;
+	}
+
+	inline T Min(ThreadPool& pool = ThreadPool::Shared()) const { return length > 0 ? reduce(signal[0], ReduceMin(), pool) : 0; }
+	inline T Max(ThreadPool& pool = ThreadPool::Shared()) const { return length > 0 ? reduce(signal[0], ReduceMax(), pool) : 0; }
+	inline double Sum(ThreadPool& pool = ThreadPool::Shared()) const { return reduce(0.0, ReduceSum(), pool); }
+	// Largest sample and the first index that holds it
+	T ArgMax(int& n, ThreadPool& pool = ThreadPool::Shared()) const {
+		n = 0;
+		T best = Max(pool);
+		for (int i = 0; i < length; ++i) {
+			if (signal[i] == best) {
+				n = i;
+				break;
+			}
+		}
+		return best;
+	}
+
+	// Samples set to f(n), f is any functor (a setter works too), enabled only when f(n) is a call
+	template<typename F, typename = decltype(std::declval<F&>()(0))>
+	Signal(int l, F f) {
+		allocate(l);
 		for (int n = 0; n < length; ++n) {
 			signal[n] = f(n);
 		}
 	}
 
+	// Zeroed
 	Signal(int l) {
-		length = l;
-		signal = new T[length]();
+		allocate(l);
+		memset(signal, 0, sizeof(T) * length);
 	}
 	Signal(int l, T v) {
-		length = l;
-		signal = new T[length];
+		allocate(l);
 		for (int n = 0; n < length; ++n) {
-			signal[n++] = v;
+			signal[n] = v;
 		}
 	}
 	Signal(int l, T* sig) {
-		length = l;
-		signal = new T[length];
+		allocate(l);
 		memcpy(signal, sig, sizeof(T) * length);
 	}
-	Signal<T>& operator=(const Signal<T>& rhs) { clean(); copy(rhs); return *this; }
+	Signal<T>& operator=(const Signal<T>& rhs) {
+		if (this != &rhs) {
+			clean();
+			copy(rhs);
+		}
+		return *this;
+	}
+	Signal<T>& operator=(Signal<T>&& rhs) {
+		if (this != &rhs) {
+			clean();
+			take(rhs);
+		}
+		return *this;
+	}
 	Signal(const Signal<T>& rhs) { copy(rhs); }
+	Signal(Signal<T>&& rhs) { take(rhs); }
 	~Signal() { clean(); }
 
 	inline const int N() const { return length; }
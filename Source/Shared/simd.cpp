@@ -0,0 +1,745 @@
+#include "simd.hpp"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC emits any intrinsic without flags, GCC/Clang need the target enabled per function
+#if defined(_MSC_VER) || !defined(SIMD_X86)
+#define SIMD_TARGET(x)
+#else
+#define SIMD_TARGET(x) __attribute__((target(x)))
+#endif
+
+// The AVX kernels finish their tails with the narrower ones, which GCC/Clang build with legacy SSE encodings
+// when no -mavx is given, so each clears the upper register state first (_mm256_zeroupper) to avoid transition stalls
+
+// Full unrolling of the compile-time tap loops (MSVC unrolls short constant trip counts on its own)
+#if defined(__GNUC__)
+#define SIMD_UNROLL _Pragma("GCC unroll 64")
+#else
+#define SIMD_UNROLL
+#endif
+
+SimdLevel SimdDetect() {
+#if defined(SIMD_X86)
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int ids = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool avx2 = false, avx512 = false;
+	if (ids >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+		avx512 = (info[1] & (1 << 16)) != 0;
+	}
+	// The OS has to save the ymm (bits 1, 2) and zmm (bits 5, 6, 7) state across context switches
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool ymm = (xcr0 & 0x6) == 0x6;
+	bool zmm = (xcr0 & 0xe6) == 0xe6;
+	if (avx && avx2 && fma && ymm) {
+		return avx512 && zmm ? SimdLevel::AVX512 : SimdLevel::AVX2;
+	}
+	if (sse2) { return SimdLevel::SSE2; }
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return __builtin_cpu_supports("avx512f") ? SimdLevel::AVX512 : SimdLevel::AVX2;
+	}
+	if (__builtin_cpu_supports("sse2")) { return SimdLevel::SSE2; }
+#endif
+#endif
+	return SimdLevel::Scalar;
+}
+
+static SimdLevel simdLevel = SimdDetect();
+
+SimdLevel SimdActive() {
+	return simdLevel;
+}
+
+void SimdOverride(SimdLevel level) {
+	SimdLevel best = SimdDetect();
+	simdLevel = level > best ? best : level;
+}
+
+// Conv2DRow
+
+static void Conv2DRowScalar(float* out, const float* src, int ld, const float* f, int MF, int NF, int count) {
+	for (int i = 0; i < count; ++i) {
+		float sum = 0;
+		for (int k = 0; k < NF; ++k) {
+			const float* s = src + i - k * ld;
+			const float* fk = f + k * MF;
+			for (int l = 0; l < MF; ++l) {
+				sum += fk[l] * s[-l];
+			}
+		}
+		out[i] = sum;
+	}
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET("sse2")
+static void Conv2DRowSSE2(float* out, const float* src, int ld, const float* f, int MF, int NF, int count) {
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		for (int k = 0; k < NF; ++k) {
+			const float* s = src + i - k * ld;
+			const float* fk = f + k * MF;
+			for (int l = 0; l < MF; ++l) {
+				__m128 c = _mm_set1_ps(fk[l]);
+				acc0 = _mm_add_ps(acc0, _mm_mul_ps(c, _mm_loadu_ps(s - l)));
+				acc1 = _mm_add_ps(acc1, _mm_mul_ps(c, _mm_loadu_ps(s - l + 4)));
+			}
+		}
+		_mm_storeu_ps(out + i, acc0);
+		_mm_storeu_ps(out + i + 4, acc1);
+	}
+	Conv2DRowScalar(out + i, src + i, ld, f, MF, NF, count - i);
+}
+
+SIMD_TARGET("avx2,fma")
+static void Conv2DRowAVX2(float* out, const float* src, int ld, const float* f, int MF, int NF, int count) {
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		for (int k = 0; k < NF; ++k) {
+			const float* s = src + i - k * ld;
+			const float* fk = f + k * MF;
+			for (int l = 0; l < MF; ++l) {
+				__m256 c = _mm256_broadcast_ss(fk + l);
+				acc0 = _mm256_fmadd_ps(c, _mm256_loadu_ps(s - l), acc0);
+				acc1 = _mm256_fmadd_ps(c, _mm256_loadu_ps(s - l + 8), acc1);
+			}
+		}
+		_mm256_storeu_ps(out + i, acc0);
+		_mm256_storeu_ps(out + i + 8, acc1);
+	}
+	_mm256_zeroupper();
+	Conv2DRowSSE2(out + i, src + i, ld, f, MF, NF, count - i);
+}
+
+SIMD_TARGET("avx512f")
+static void Conv2DRowAVX512(float* out, const float* src, int ld, const float* f, int MF, int NF, int count) {
+	int i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m512 acc0 = _mm512_setzero_ps();
+		__m512 acc1 = _mm512_setzero_ps();
+		for (int k = 0; k < NF; ++k) {
+			const float* s = src + i - k * ld;
+			const float* fk = f + k * MF;
+			for (int l = 0; l < MF; ++l) {
+				__m512 c = _mm512_set1_ps(fk[l]);
+				acc0 = _mm512_fmadd_ps(c, _mm512_loadu_ps(s - l), acc0);
+				acc1 = _mm512_fmadd_ps(c, _mm512_loadu_ps(s - l + 16), acc1);
+			}
+		}
+		_mm512_storeu_ps(out + i, acc0);
+		_mm512_storeu_ps(out + i + 16, acc1);
+	}
+	_mm256_zeroupper();
+	Conv2DRowAVX2(out + i, src + i, ld, f, MF, NF, count - i);
+}
+#endif
+
+void Conv2DRow(float* out, const float* src, int ld, const float* f, int MF, int NF, int count) {
+#if defined(SIMD_X86)
+	switch (simdLevel) {
+		case SimdLevel::AVX512: Conv2DRowAVX512(out, src, ld, f, MF, NF, count); return;
+		case SimdLevel::AVX2: Conv2DRowAVX2(out, src, ld, f, MF, NF, count); return;
+		case SimdLevel::SSE2: Conv2DRowSSE2(out, src, ld, f, MF, NF, count); return;
+		default: break;
+	}
+#endif
+	Conv2DRowScalar(out, src, ld, f, MF, NF, count);
+}
+
+// Conv2DRowSym
+
+static void Conv2DRowSymScalar(float* out, const float* src, int ld, const float* f, int MF, int NF, int sign, int count) {
+	int half = MF / 2;
+	for (int i = 0; i < count; ++i) {
+		float sum = 0;
+		for (int k = 0; k < NF; ++k) {
+			const float* s = src + i - k * ld;
+			const float* fk = f + k * MF;
+			for (int l = 0; l < half; ++l) {
+				sum += fk[l] * (s[-l] + sign * s[l + 1 - MF]);
+			}
+			if (MF & 1) { sum += fk[half] * s[-half]; }
+		}
+		out[i] = sum;
+	}
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET("sse2")
+static void Conv2DRowSymSSE2(float* out, const float* src, int ld, const float* f, int MF, int NF, int sign, int count) {
+	int half = MF / 2;
+	// Flipping the sign bit of the mirrored sample turns the add into a subtract
+	__m128 flip = _mm_set1_ps(sign < 0 ? -0.0f : 0.0f);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		for (int k = 0; k < NF; ++k) {
+			const float* s = src + i - k * ld;
+			const float* fk = f + k * MF;
+			for (int l = 0; l < half; ++l) {
+				__m128 c = _mm_set1_ps(fk[l]);
+				const float* t = s + l + 1 - MF;
+				acc0 = _mm_add_ps(acc0, _mm_mul_ps(c, _mm_add_ps(_mm_loadu_ps(s - l), _mm_xor_ps(_mm_loadu_ps(t), flip))));
+				acc1 = _mm_add_ps(acc1, _mm_mul_ps(c, _mm_add_ps(_mm_loadu_ps(s - l + 4), _mm_xor_ps(_mm_loadu_ps(t + 4), flip))));
+			}
+			if (MF & 1) {
+				__m128 c = _mm_set1_ps(fk[half]);
+				acc0 = _mm_add_ps(acc0, _mm_mul_ps(c, _mm_loadu_ps(s - half)));
+				acc1 = _mm_add_ps(acc1, _mm_mul_ps(c, _mm_loadu_ps(s - half + 4)));
+			}
+		}
+		_mm_storeu_ps(out + i, acc0);
+		_mm_storeu_ps(out + i + 4, acc1);
+	}
+	Conv2DRowSymScalar(out + i, src + i, ld, f, MF, NF, sign, count - i);
+}
+
+SIMD_TARGET("avx2,fma")
+static void Conv2DRowSymAVX2(float* out, const float* src, int ld, const float* f, int MF, int NF, int sign, int count) {
+	int half = MF / 2;
+	__m256 flip = _mm256_set1_ps(sign < 0 ? -0.0f : 0.0f);
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		for (int k = 0; k < NF; ++k) {
+			const float* s = src + i - k * ld;
+			const float* fk = f + k * MF;
+			for (int l = 0; l < half; ++l) {
+				__m256 c = _mm256_broadcast_ss(fk + l);
+				const float* t = s + l + 1 - MF;
+				acc0 = _mm256_fmadd_ps(c, _mm256_add_ps(_mm256_loadu_ps(s - l), _mm256_xor_ps(_mm256_loadu_ps(t), flip)), acc0);
+				acc1 = _mm256_fmadd_ps(c, _mm256_add_ps(_mm256_loadu_ps(s - l + 8), _mm256_xor_ps(_mm256_loadu_ps(t + 8), flip)), acc1);
+			}
+			if (MF & 1) {
+				__m256 c = _mm256_broadcast_ss(fk + half);
+				acc0 = _mm256_fmadd_ps(c, _mm256_loadu_ps(s - half), acc0);
+				acc1 = _mm256_fmadd_ps(c, _mm256_loadu_ps(s - half + 8), acc1);
+			}
+		}
+		_mm256_storeu_ps(out + i, acc0);
+		_mm256_storeu_ps(out + i + 8, acc1);
+	}
+	_mm256_zeroupper();
+	Conv2DRowSymSSE2(out + i, src + i, ld, f, MF, NF, sign, count - i);
+}
+
+SIMD_TARGET("avx512f")
+static void Conv2DRowSymAVX512(float* out, const float* src, int ld, const float* f, int MF, int NF, int sign, int count) {
+	int half = MF / 2;
+	__m512 flip = _mm512_castsi512_ps(_mm512_set1_epi32(sign < 0 ? (int)0x80000000 : 0));
+	int i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m512 acc0 = _mm512_setzero_ps();
+		__m512 acc1 = _mm512_setzero_ps();
+		for (int k = 0; k < NF; ++k) {
+			const float* s = src + i - k * ld;
+			const float* fk = f + k * MF;
+			for (int l = 0; l < half; ++l) {
+				__m512 c = _mm512_set1_ps(fk[l]);
+				const float* t = s + l + 1 - MF;
+				// AVX-512F has no float xor, flip the sign through the integer one
+				__m512 t0 = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_loadu_ps(t)), _mm512_castps_si512(flip)));
+				__m512 t1 = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_loadu_ps(t + 16)), _mm512_castps_si512(flip)));
+				acc0 = _mm512_fmadd_ps(c, _mm512_add_ps(_mm512_loadu_ps(s - l), t0), acc0);
+				acc1 = _mm512_fmadd_ps(c, _mm512_add_ps(_mm512_loadu_ps(s - l + 16), t1), acc1);
+			}
+			if (MF & 1) {
+				__m512 c = _mm512_set1_ps(fk[half]);
+				acc0 = _mm512_fmadd_ps(c, _mm512_loadu_ps(s - half), acc0);
+				acc1 = _mm512_fmadd_ps(c, _mm512_loadu_ps(s - half + 16), acc1);
+			}
+		}
+		_mm512_storeu_ps(out + i, acc0);
+		_mm512_storeu_ps(out + i + 16, acc1);
+	}
+	_mm256_zeroupper();
+	Conv2DRowSymAVX2(out + i, src + i, ld, f, MF, NF, sign, count - i);
+}
+#endif
+
+void Conv2DRowSym(float* out, const float* src, int ld, const float* f, int MF, int NF, int sign, int count) {
+#if defined(SIMD_X86)
+	switch (simdLevel) {
+		case SimdLevel::AVX512: Conv2DRowSymAVX512(out, src, ld, f, MF, NF, sign, count); return;
+		case SimdLevel::AVX2: Conv2DRowSymAVX2(out, src, ld, f, MF, NF, sign, count); return;
+		case SimdLevel::SSE2: Conv2DRowSymSSE2(out, src, ld, f, MF, NF, sign, count); return;
+		default: break;
+	}
+#endif
+	Conv2DRowSymScalar(out, src, ld, f, MF, NF, sign, count);
+}
+
+// Conv2DRowFixed
+
+template<int MF, int NF>
+static void Conv2DRowFixedScalar(float* out, const float* src, int ld, const float* f, int count) {
+	for (int i = 0; i < count; ++i) {
+		float sum = 0;
+		SIMD_UNROLL
+		for (int k = 0; k < NF; ++k) {
+			SIMD_UNROLL
+			for (int l = 0; l < MF; ++l) {
+				sum += f[k * MF + l] * src[i - k * ld - l];
+			}
+		}
+		out[i] = sum;
+	}
+}
+
+#if defined(SIMD_X86)
+template<int MF, int NF>
+SIMD_TARGET("sse2")
+static void Conv2DRowFixedSSE2(float* out, const float* src, int ld, const float* f, int count) {
+	__m128 c[MF * NF];
+	SIMD_UNROLL
+	for (int t = 0; t < MF * NF; ++t) { c[t] = _mm_set1_ps(f[t]); }
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		SIMD_UNROLL
+		for (int k = 0; k < NF; ++k) {
+			const float* s = src + i - k * ld;
+			SIMD_UNROLL
+			for (int l = 0; l < MF; ++l) {
+				acc0 = _mm_add_ps(acc0, _mm_mul_ps(c[k * MF + l], _mm_loadu_ps(s - l)));
+				acc1 = _mm_add_ps(acc1, _mm_mul_ps(c[k * MF + l], _mm_loadu_ps(s - l + 4)));
+			}
+		}
+		_mm_storeu_ps(out + i, acc0);
+		_mm_storeu_ps(out + i + 4, acc1);
+	}
+	Conv2DRowFixedScalar<MF, NF>(out + i, src + i, ld, f, count - i);
+}
+
+template<int MF, int NF>
+SIMD_TARGET("avx2,fma")
+static void Conv2DRowFixedAVX2(float* out, const float* src, int ld, const float* f, int count) {
+	// 25 or 49 taps don't fit the register file, so broadcast each from memory at its FMA instead of keeping
+	// them all live (they would only spill)
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		SIMD_UNROLL
+		for (int k = 0; k < NF; ++k) {
+			const float* s = src + i - k * ld;
+			SIMD_UNROLL
+			for (int l = 0; l < MF; ++l) {
+				__m256 c = _mm256_set1_ps(f[k * MF + l]);
+				acc0 = _mm256_fmadd_ps(c, _mm256_loadu_ps(s - l), acc0);
+				acc1 = _mm256_fmadd_ps(c, _mm256_loadu_ps(s - l + 8), acc1);
+			}
+		}
+		_mm256_storeu_ps(out + i, acc0);
+		_mm256_storeu_ps(out + i + 8, acc1);
+	}
+	_mm256_zeroupper();
+	Conv2DRowFixedSSE2<MF, NF>(out + i, src + i, ld, f, count - i);
+}
+
+template<int MF, int NF>
+SIMD_TARGET("avx512f")
+static void Conv2DRowFixedAVX512(float* out, const float* src, int ld, const float* f, int count) {
+	// Taps broadcast at their FMA, as in the AVX2 version
+	int i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m512 acc0 = _mm512_setzero_ps();
+		__m512 acc1 = _mm512_setzero_ps();
+		SIMD_UNROLL
+		for (int k = 0; k < NF; ++k) {
+			const float* s = src + i - k * ld;
+			SIMD_UNROLL
+			for (int l = 0; l < MF; ++l) {
+				__m512 c = _mm512_set1_ps(f[k * MF + l]);
+				acc0 = _mm512_fmadd_ps(c, _mm512_loadu_ps(s - l), acc0);
+				acc1 = _mm512_fmadd_ps(c, _mm512_loadu_ps(s - l + 16), acc1);
+			}
+		}
+		_mm512_storeu_ps(out + i, acc0);
+		_mm512_storeu_ps(out + i + 16, acc1);
+	}
+	_mm256_zeroupper();
+	Conv2DRowFixedAVX2<MF, NF>(out + i, src + i, ld, f, count - i);
+}
+#endif
+
+template<int MF, int NF>
+void Conv2DRowFixed(float* out, const float* src, int ld, const float* f, int count) {
+#if defined(SIMD_X86)
+	switch (simdLevel) {
+		case SimdLevel::AVX512: Conv2DRowFixedAVX512<MF, NF>(out, src, ld, f, count); return;
+		case SimdLevel::AVX2: Conv2DRowFixedAVX2<MF, NF>(out, src, ld, f, count); return;
+		case SimdLevel::SSE2: Conv2DRowFixedSSE2<MF, NF>(out, src, ld, f, count); return;
+		default: break;
+	}
+#endif
+	Conv2DRowFixedScalar<MF, NF>(out, src, ld, f, count);
+}
+
+template void Conv2DRowFixed<3, 3>(float*, const float*, int, const float*, int);
+template void Conv2DRowFixed<5, 5>(float*, const float*, int, const float*, int);
+template void Conv2DRowFixed<7, 7>(float*, const float*, int, const float*, int);
+
+// Conv2DRowInt
+
+static void Conv2DRowIntScalar(byte* out, const byte* src, const int* offsets, const int* pairs, int taps, int bias, int shift, int count) {
+	for (int i = 0; i < count; ++i) {
+		int sum = bias;
+		for (int j = 0; j < taps / 2; ++j) {
+			sum += (short)(pairs[j] & 0xffff) * src[i + offsets[2 * j]];
+			sum += (short)(pairs[j] >> 16) * src[i + offsets[2 * j + 1]];
+		}
+		sum >>= shift;
+		out[i] = (byte)(sum < 0 ? 0 : sum > 255 ? 255 : sum);
+	}
+}
+
+#if defined(SIMD_X86)
+// Pixels are widened to int16 and the two taps of a pair interleaved, so pmaddwd does both multiplies and the add
+SIMD_TARGET("sse2")
+static void Conv2DRowIntSSE2(byte* out, const byte* src, const int* offsets, const int* pairs, int taps, int bias, int shift, int count) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i sh = _mm_cvtsi32_si128(shift);
+	__m128i b0 = _mm_set1_epi32(bias);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i acc0 = b0;
+		__m128i acc1 = b0;
+		for (int j = 0; j < taps / 2; ++j) {
+			__m128i c = _mm_set1_epi32(pairs[j]);
+			__m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src + i + offsets[2 * j])), zero);
+			__m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src + i + offsets[2 * j + 1])), zero);
+			acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), c));
+			acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), c));
+		}
+		__m128i v = _mm_packs_epi32(_mm_sra_epi32(acc0, sh), _mm_sra_epi32(acc1, sh));
+		_mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(v, v));
+	}
+	Conv2DRowIntScalar(out + i, src + i, offsets, pairs, taps, bias, shift, count - i);
+}
+
+// unpack/pack work within 128-bit lanes, acc0 holds outputs 0-3 and 8-11, acc1 4-7 and 12-15, which packs back in order
+SIMD_TARGET("avx2")
+static void Conv2DRowIntAVX2(byte* out, const byte* src, const int* offsets, const int* pairs, int taps, int bias, int shift, int count) {
+	__m128i sh = _mm_cvtsi32_si128(shift);
+	__m256i b0 = _mm256_set1_epi32(bias);
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256i acc0 = b0;
+		__m256i acc1 = b0;
+		for (int j = 0; j < taps / 2; ++j) {
+			__m256i c = _mm256_set1_epi32(pairs[j]);
+			__m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i + offsets[2 * j])));
+			__m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i + offsets[2 * j + 1])));
+			acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), c));
+			acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), c));
+		}
+		__m256i v = _mm256_packs_epi32(_mm256_sra_epi32(acc0, sh), _mm256_sra_epi32(acc1, sh));
+		v = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+		_mm_storeu_si128((__m128i*)(out + i), _mm256_castsi256_si128(v));
+	}
+	_mm256_zeroupper();
+	Conv2DRowIntSSE2(out + i, src + i, offsets, pairs, taps, bias, shift, count - i);
+}
+#endif
+
+// The 16-bit multiply-adds need AVX-512BW for zmm, AVX512F-only machines run the AVX2 kernel
+void Conv2DRowInt(byte* out, const byte* src, const int* offsets, const int* pairs, int taps, int bias, int shift, int count) {
+#if defined(SIMD_X86)
+	switch (simdLevel) {
+		case SimdLevel::AVX512:
+		case SimdLevel::AVX2: Conv2DRowIntAVX2(out, src, offsets, pairs, taps, bias, shift, count); return;
+		case SimdLevel::SSE2: Conv2DRowIntSSE2(out, src, offsets, pairs, taps, bias, shift, count); return;
+		default: break;
+	}
+#endif
+	Conv2DRowIntScalar(out, src, offsets, pairs, taps, bias, shift, count);
+}
+
+// DotF32
+
+static float DotF32Scalar(const float* a, const float* b, int n) {
+	float sum = 0;
+	for (int i = 0; i < n; ++i) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET("sse2")
+static float DotF32SSE2(const float* a, const float* b, int n) {
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	acc0 = _mm_add_ps(acc0, acc1);
+	acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+	acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+	return i < n ? _mm_cvtss_f32(acc0) + DotF32Scalar(a + i, b + i, n - i) : _mm_cvtss_f32(acc0);
+}
+
+SIMD_TARGET("avx2,fma")
+static float DotF32AVX2(const float* a, const float* b, int n) {
+	__m256 acc0 = _mm256_setzero_ps();
+	__m256 acc1 = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+		acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+	}
+	acc0 = _mm256_add_ps(acc0, acc1);
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	float head = _mm_cvtss_f32(sum);
+	_mm256_zeroupper();
+	return i < n ? head + DotF32SSE2(a + i, b + i, n - i) : head;
+}
+
+SIMD_TARGET("avx512f")
+static float DotF32AVX512(const float* a, const float* b, int n) {
+	__m512 acc0 = _mm512_setzero_ps();
+	__m512 acc1 = _mm512_setzero_ps();
+	int i = 0;
+	for (; i + 32 <= n; i += 32) {
+		acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+		acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+	}
+	if (i + 16 <= n) {
+		acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+		i += 16;
+	}
+	// Masked loads for the last few, no narrower kernel needed
+	if (i < n) {
+		__mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+		acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), acc1);
+	}
+	// Fold the four 128 bit lanes with full-mask lane swaps, then the same horizontal sum as the AVX2 kernel.
+	// The masked forms take an explicit pass-through source, the unmasked extract/shuffle/cast intrinsics
+	// (and _mm512_reduce_add_ps) use an undefined one that GCC 12 warns about.
+	acc0 = _mm512_add_ps(acc0, acc1);
+	acc0 = _mm512_add_ps(acc0, _mm512_mask_shuffle_f32x4(acc0, 0xFFFF, acc0, acc0, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc0 = _mm512_add_ps(acc0, _mm512_mask_shuffle_f32x4(acc0, 0xFFFF, acc0, acc0, _MM_SHUFFLE(2, 3, 0, 1)));
+	__m128 sum = _mm512_mask_extractf32x4_ps(_mm_setzero_ps(), 0xF, acc0, 0);
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	float total = _mm_cvtss_f32(sum);
+	_mm256_zeroupper();
+	return total;
+}
+#endif
+
+float DotF32(const float* a, const float* b, int n) {
+#if defined(SIMD_X86)
+	switch (simdLevel) {
+		case SimdLevel::AVX512: return DotF32AVX512(a, b, n);
+		case SimdLevel::AVX2: return DotF32AVX2(a, b, n);
+		case SimdLevel::SSE2: return DotF32SSE2(a, b, n);
+		default: break;
+	}
+#endif
+	return DotF32Scalar(a, b, n);
+}
+
+// DotF32x16
+
+static void DotF32x16Scalar(const float* a, const float* b, int n, float* acc) {
+	for (int k = 0; k < 16; ++k) { acc[k] = 0; }
+	for (int i = 0; i < n; i += 16) {
+		for (int k = 0; k < 16; ++k) {
+			acc[k] += a[i + k] * b[i + k];
+		}
+	}
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET("sse2")
+static void DotF32x16SSE2(const float* a, const float* b, int n, float* acc) {
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	__m128 acc2 = _mm_setzero_ps();
+	__m128 acc3 = _mm_setzero_ps();
+	for (int i = 0; i < n; i += 16) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+		acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_loadu_ps(a + i + 8), _mm_loadu_ps(b + i + 8)));
+		acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_loadu_ps(a + i + 12), _mm_loadu_ps(b + i + 12)));
+	}
+	_mm_storeu_ps(acc, acc0);
+	_mm_storeu_ps(acc + 4, acc1);
+	_mm_storeu_ps(acc + 8, acc2);
+	_mm_storeu_ps(acc + 12, acc3);
+}
+
+SIMD_TARGET("avx2,fma")
+static void DotF32x16AVX2(const float* a, const float* b, int n, float* acc) {
+	__m256 acc0 = _mm256_setzero_ps();
+	__m256 acc1 = _mm256_setzero_ps();
+	__m256 acc2 = _mm256_setzero_ps();
+	__m256 acc3 = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 32 <= n; i += 32) {
+		acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+		acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+		acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+		acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+	}
+	if (i < n) {
+		acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+		acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+	}
+	_mm256_storeu_ps(acc, _mm256_add_ps(acc0, acc2));
+	_mm256_storeu_ps(acc + 8, _mm256_add_ps(acc1, acc3));
+	_mm256_zeroupper();
+}
+
+SIMD_TARGET("avx512f")
+static void DotF32x16AVX512(const float* a, const float* b, int n, float* acc) {
+	__m512 acc0 = _mm512_setzero_ps();
+	__m512 acc1 = _mm512_setzero_ps();
+	int i = 0;
+	for (; i + 32 <= n; i += 32) {
+		acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+		acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+	}
+	if (i < n) {
+		acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+	}
+	_mm512_storeu_ps(acc, _mm512_add_ps(acc0, acc1));
+	_mm256_zeroupper();
+}
+#endif
+
+void DotF32x16(const float* a, const float* b, int n, float* acc) {
+#if defined(SIMD_X86)
+	switch (simdLevel) {
+		case SimdLevel::AVX512: DotF32x16AVX512(a, b, n, acc); return;
+		case SimdLevel::AVX2: DotF32x16AVX2(a, b, n, acc); return;
+		case SimdLevel::SSE2: DotF32x16SSE2(a, b, n, acc); return;
+		default: break;
+	}
+#endif
+	DotF32x16Scalar(a, b, n, acc);
+}
+
+// DotF32Bcast
+
+static void DotF32BcastScalar(const float* c, const float* x, int ld, int taps, int channels, float* out) {
+	for (int ch = 0; ch < channels; ++ch) { out[ch] = 0; }
+	for (int r = 0; r < taps; ++r) {
+		for (int ch = 0; ch < channels; ++ch) {
+			out[ch] += c[r] * x[r * ld + ch];
+		}
+	}
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET("sse2")
+static void DotF32BcastSSE2(const float* c, const float* x, int ld, int taps, int channels, float* out) {
+	for (int ch = 0; ch < channels; ch += 8) {
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		const float* src = x + ch;
+		for (int r = 0; r < taps; ++r, src += ld) {
+			__m128 cr = _mm_set1_ps(c[r]);
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(cr, _mm_loadu_ps(src)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(cr, _mm_loadu_ps(src + 4)));
+		}
+		_mm_storeu_ps(out + ch, acc0);
+		_mm_storeu_ps(out + ch + 4, acc1);
+	}
+}
+
+SIMD_TARGET("avx2,fma")
+static void DotF32BcastAVX2(const float* c, const float* x, int ld, int taps, int channels, float* out) {
+	for (int ch = 0; ch < channels; ch += 8) {
+		// Four taps in separate chains to hide the FMA latency
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		__m256 acc2 = _mm256_setzero_ps();
+		__m256 acc3 = _mm256_setzero_ps();
+		const float* src = x + ch;
+		int r = 0;
+		for (; r + 4 <= taps; r += 4, src += 4 * ld) {
+			acc0 = _mm256_fmadd_ps(_mm256_set1_ps(c[r]), _mm256_loadu_ps(src), acc0);
+			acc1 = _mm256_fmadd_ps(_mm256_set1_ps(c[r + 1]), _mm256_loadu_ps(src + ld), acc1);
+			acc2 = _mm256_fmadd_ps(_mm256_set1_ps(c[r + 2]), _mm256_loadu_ps(src + 2 * ld), acc2);
+			acc3 = _mm256_fmadd_ps(_mm256_set1_ps(c[r + 3]), _mm256_loadu_ps(src + 3 * ld), acc3);
+		}
+		for (; r < taps; ++r, src += ld) {
+			acc0 = _mm256_fmadd_ps(_mm256_set1_ps(c[r]), _mm256_loadu_ps(src), acc0);
+		}
+		_mm256_storeu_ps(out + ch, _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+	}
+	_mm256_zeroupper();
+}
+
+SIMD_TARGET("avx512f")
+static void DotF32BcastAVX512(const float* c, const float* x, int ld, int taps, int channels, float* out) {
+	int ch = 0;
+	for (; ch + 16 <= channels; ch += 16) {
+		__m512 acc0 = _mm512_setzero_ps();
+		__m512 acc1 = _mm512_setzero_ps();
+		__m512 acc2 = _mm512_setzero_ps();
+		__m512 acc3 = _mm512_setzero_ps();
+		const float* src = x + ch;
+		int r = 0;
+		for (; r + 4 <= taps; r += 4, src += 4 * ld) {
+			acc0 = _mm512_fmadd_ps(_mm512_set1_ps(c[r]), _mm512_loadu_ps(src), acc0);
+			acc1 = _mm512_fmadd_ps(_mm512_set1_ps(c[r + 1]), _mm512_loadu_ps(src + ld), acc1);
+			acc2 = _mm512_fmadd_ps(_mm512_set1_ps(c[r + 2]), _mm512_loadu_ps(src + 2 * ld), acc2);
+			acc3 = _mm512_fmadd_ps(_mm512_set1_ps(c[r + 3]), _mm512_loadu_ps(src + 3 * ld), acc3);
+		}
+		for (; r < taps; ++r, src += ld) {
+			acc0 = _mm512_fmadd_ps(_mm512_set1_ps(c[r]), _mm512_loadu_ps(src), acc0);
+		}
+		_mm512_storeu_ps(out + ch, _mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+	}
+	// 8 channels left at most
+	if (ch < channels) {
+		DotF32BcastAVX2(c, x + ch, ld, taps, channels - ch, out + ch);
+	}
+	_mm256_zeroupper();
+}
+#endif
+
+void DotF32Bcast(const float* c, const float* x, int ld, int taps, int channels, float* out) {
+#if defined(SIMD_X86)
+	switch (simdLevel) {
+		case SimdLevel::AVX512: DotF32BcastAVX512(c, x, ld, taps, channels, out); return;
+		case SimdLevel::AVX2: DotF32BcastAVX2(c, x, ld, taps, channels, out); return;
+		case SimdLevel::SSE2: DotF32BcastSSE2(c, x, ld, taps, channels, out); return;
+		default: break;
+	}
+#endif
+	DotF32BcastScalar(c, x, ld, taps, channels, out);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "types.h"
+
+// Instruction sets the hot loops are built for, picked at runtime from what the CPU (and OS) supports
+enum class SimdLevel {
+	Scalar,
+	SSE2,
+	AVX2,   // AVX2 + FMA
+	AVX512, // AVX-512F
+};
+
+// Best level this machine supports
+SimdLevel SimdDetect();
+
+// Level the kernels below dispatch to (SimdDetect() unless overridden, e.g. for benchmarks)
+SimdLevel SimdActive();
+void SimdOverride(SimdLevel level);
+
+// Interior 2D convolution over one output row segment, no bounds checks
+// out[i] = sum_k sum_l f[k * MF + l] * src[i - k * ld - l], for i in [0, count)
+void Conv2DRow(float* out, const float* src, int ld, const float* f, int MF, int NF, int count);
+
+// Same as Conv2DRow for a compile-time MF x NF kernel (instantiated for 3x3, 5x5 and 7x7)
+// The tap loops unroll completely and the broadcast coefficients are hoisted out of the pixel loop
+template<int MF, int NF>
+void Conv2DRowFixed(float* out, const float* src, int ld, const float* f, int count);
+
+// Conv2DRow for a kernel mirrored along its rows, f[k * MF + l] = sign * f[k * MF + MF - 1 - l] (sign +1 or -1)
+// Mirrored samples are added (or subtracted) first so each pair of taps costs one multiply
+void Conv2DRowSym(float* out, const float* src, int ld, const float* f, int MF, int NF, int sign, int count);
+
+// Integer interior convolution of 8-bit pixels over one output row segment, no bounds checks
+// Tap t reads src[i + offsets[t]] and the taps are paired for 16-bit multiply-adds, pairs[j] holds the int16
+// coefficients of taps 2j (low half) and 2j + 1 (high half), taps is even (pad with a zero coefficient)
+// out[i] = saturate((bias + sum_t c_t * src[i + offsets[t]]) >> shift), for i in [0, count), accumulated in int32
+void Conv2DRowInt(byte* out, const byte* src, const int* offsets, const int* pairs, int taps, int bias, int shift, int count);
+
+// sum_i a[i] * b[i], for i in [0, n)
+float DotF32(const float* a, const float* b, int n);
+
+// Lane sums of an elementwise product, n a multiple of 16
+// acc[k] = sum_i a[i] * b[i], for the i in [0, n) with i mod 16 = k
+void DotF32x16(const float* a, const float* b, int n, float* acc);
+
+// One coefficient against several interleaved streams, channels a multiple of 8
+// out[ch] = sum_r c[r] * x[r * ld + ch], for r in [0, taps) and ch in [0, channels)
+void DotF32Bcast(const float* c, const float* x, int ld, int taps, int channels, float* out);